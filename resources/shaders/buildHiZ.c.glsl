@@ -0,0 +1,44 @@
+#version 430
+
+/*
+  Builds one level of a hierarchical-Z pyramid from the level below
+  (or from the samples image). Each texel keeps the furthest of the 4
+  beneath it, so anything further than a texel's value is certainly
+  behind everything drawn in its area - unless the area had an empty
+  sample, in which case the texel is empty (0) and hides nothing.
+*/
+
+layout (local_size_x = 8, local_size_y = 8, local_size_z = 1) in;
+
+layout (r32ui, binding = 3) readonly uniform uimage2D source;
+layout (r32ui, binding = 4) writeonly uniform uimage2D target;
+
+//Not imageSize(); see class image
+layout (location = 6) uniform uvec2 sourceXY;
+layout (location = 7) uniform uvec2 targetXY;
+
+uint loadSource(ivec2 coords)
+{
+   //Texels past the edge of the source (when its size is odd) don't
+   //exist, so mustn't make their parent any further.
+   if (any(greaterThanEqual(uvec2(coords), sourceXY))) { return ~0u; }
+
+   return imageLoad(source, coords).r;
+}
+
+void main()
+{
+   const ivec2 coords = ivec2(gl_GlobalInvocationID.xy);
+
+   if (any(greaterThanEqual(uvec2(coords), targetXY))) { return; }
+
+   ivec2 base = coords * 2;
+
+   //Samples are ~0 - depth, so the furthest is the minimum.
+   uint furthest = min(min(loadSource(base),
+			   loadSource(base + ivec2(1, 0))),
+		       min(loadSource(base + ivec2(0, 1)),
+			   loadSource(base + ivec2(1, 1))));
+
+   imageStore(target, coords, uvec4(furthest));
+}
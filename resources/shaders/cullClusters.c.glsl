@@ -0,0 +1,227 @@
+#version 430
+
+/*
+  Culls clusters of surfels (runs of CLUSTER_SIZE surfels, close
+  together in space - see surfelModel::prep()) against the view
+  frustum and a hierarchical-Z pyramid, appending the survivors to a
+  list which surfelsToSamples is then dispatched over indirectly.
+
+  Two phases: the first tests every cluster against the pyramid from
+  the last frame, and puts those it hides aside in a deferred list;
+  the second tests the deferred clusters again, against a pyramid of
+  what the first phase drew, to catch those uncovered since.
+
+  Compiled with FINALIZE, it's instead a single invocation which turns
+  the lists' counts into dispatch sizes.
+*/
+
+#ifndef CULL_LOCAL_SIZE
+#define CULL_LOCAL_SIZE 64
+#endif
+
+#ifdef FINALIZE
+layout (local_size_x = 1, local_size_y = 1, local_size_z = 1) in;
+#else
+layout (local_size_x = CULL_LOCAL_SIZE, local_size_y = 1, local_size_z = 1) in;
+#endif
+
+//Min then max corner of each cluster's bounds
+layout (std430, binding = 4) readonly buffer clustersBlock
+{
+   vec4 bounds[];
+} clusters;
+
+/*
+  The lists start with the indirect dispatch size for whatever's
+  dispatched over them (see FINALIZE).
+*/
+layout (std430, binding = 5) readonly buffer candidatesBlock
+{
+   uint groups[3];
+   uint count;
+   uint ids[];
+} candidates;
+
+layout (std430, binding = 6) buffer visibleBlock
+{
+   uint groups[3];
+   uint count;
+   uint ids[];
+} visible;
+
+layout (std430, binding = 7) buffer deferredBlock
+{
+   uint groups[3];
+   uint count;
+   uint ids[];
+} deferred;
+
+//0: first phase (all clusters). 1: second phase (deferred ones).
+layout (location = 3) uniform int phase;
+
+#ifdef FINALIZE
+
+layout (location = 8) uniform uint maxGroupsX;
+
+void main()
+{
+   //surfelsToSamples: one workgroup per cluster, wrapping into y past
+   //the maximum number of workgroups in x.
+   uint numVisible = visible.count;
+
+   visible.groups[0] = min(numVisible, maxGroupsX);
+   visible.groups[1] = (numVisible + maxGroupsX - 1u) / maxGroupsX;
+   visible.groups[2] = 1u;
+
+   //The second phase: one invocation per deferred cluster
+   if (phase == 0)
+   {
+      deferred.groups[0] = (deferred.count + CULL_LOCAL_SIZE - 1u) / CULL_LOCAL_SIZE;
+      deferred.groups[1] = 1u;
+      deferred.groups[2] = 1u;
+   }
+}
+
+#else
+
+layout (location = 0) uniform mat4 perspective;
+
+//Size of the samples image the pyramid was made from
+layout (location = 1) uniform uvec2 samplesXY;
+
+layout (location = 2) uniform uint numClusters;
+
+//Levels of the pyramid; 0 if there isn't a usable one yet.
+layout (location = 4) uniform uint hiZLevels;
+
+//Level 0 is half the size of the samples image (see class pyramid)
+layout (binding = 0) uniform usampler2D hiZ;
+
+void append(uint cluster)
+{
+   visible.ids[atomicAdd(visible.count, 1u)] = cluster;
+}
+
+void defer(uint cluster)
+{
+   deferred.ids[atomicAdd(deferred.count, 1u)] = cluster;
+}
+
+bool occluded(vec2 ndcLow, vec2 ndcHigh, float nearestDepth)
+{
+   //Bounds in samples, as in surfelsToSamples' getWindowCoords()
+   vec2 halfSize = vec2(samplesXY) * 0.5;
+   vec2 highest = vec2(samplesXY) - 1.0;
+
+   vec2 low = clamp(halfSize * (ndcLow + 1.0), vec2(0.0), highest);
+   vec2 high = clamp(halfSize * (ndcHigh + 1.0), vec2(0.0), highest);
+
+   //Choose the level whose texels are at least as wide as the
+   //bounds, so they cover at most 2x2 of them. Level n's texels are
+   //2^(n + 1) samples wide.
+   float size = max(max(high.x - low.x, high.y - low.y), 1.0);
+
+   uint level = uint(max(int(ceil(log2(size))) - 1, 0));
+
+   if (level >= hiZLevels) { return false; }
+
+   uint texelSize = 2u << level;
+
+   uvec2 levelXY = (samplesXY + texelSize - 1u) / texelSize;
+
+   ivec2 first = ivec2(low) / int(texelSize);
+   ivec2 last = min(ivec2(high) / int(texelSize), ivec2(levelXY) - 1);
+
+   uint furthest = ~0u;
+
+   for (int y = first.y; y <= last.y; ++y)
+   {
+      for (int x = first.x; x <= last.x; ++x)
+      {
+	 furthest = min(furthest, texelFetch(hiZ, ivec2(x, y), int(level)).r);
+      }
+   }
+
+   //Samples are ~0 - depth (see surfelsToSamples), and 0 is empty -
+   //which never hides anything.
+   uint nearest = ~0u - uint(nearestDepth);
+
+   return nearest < furthest;
+}
+
+void main()
+{
+   uint slot = gl_GlobalInvocationID.x;
+   uint cluster;
+
+   if (phase == 0)
+   {
+      if (slot >= numClusters) { return; }
+
+      cluster = slot;
+   }
+
+   else
+   {
+      if (slot >= candidates.count) { return; }
+
+      cluster = candidates.ids[slot];
+   }
+
+   vec3 low = clusters.bounds[cluster * 2u].xyz;
+   vec3 high = clusters.bounds[cluster * 2u + 1u].xyz;
+
+   vec2 ndcLow = vec2(1.0e30);
+   vec2 ndcHigh = vec2(-1.0e30);
+   float nearestDepth = 1.0e30;
+
+   int numBehind = 0;
+   bool beyondFar = true;
+
+   for (int i = 0; i < 8; ++i)
+   {
+      vec3 corner = vec3(((i & 1) != 0) ? high.x : low.x,
+			 ((i & 2) != 0) ? high.y : low.y,
+			 ((i & 4) != 0) ? high.z : low.z);
+
+      vec4 point = perspective * vec4(corner, 1.0);
+
+      //Behind the camera, projection turns things inside out.
+      if (point.w <= 0.0) { ++numBehind; continue; }
+
+      vec3 ndc = point.xyz / point.w;
+
+      ndcLow = min(ndcLow, ndc.xy);
+      ndcHigh = max(ndcHigh, ndc.xy);
+
+      nearestDepth = min(nearestDepth, point.w);
+
+      beyondFar = beyondFar && (ndc.z > 1.0);
+   }
+
+   if (numBehind == 8) { return; }
+
+   //Straddling the camera's plane: too close to test, so draw it.
+   if (numBehind == 0)
+   {
+      if (any(greaterThan(ndcLow, vec2(1.0))) ||
+	  any(lessThan(ndcHigh, vec2(-1.0))) ||
+	  beyondFar)
+      {
+	 return;
+      }
+
+      if ((hiZLevels > 0u) && occluded(ndcLow, ndcHigh, nearestDepth))
+      {
+	 //Hidden last frame; check again once this frame's first
+	 //phase has been drawn.
+	 if (phase == 0) { defer(cluster); }
+
+	 return;
+      }
+   }
+
+   append(cluster);
+}
+
+#endif
@@ -0,0 +1,159 @@
+#version 430
+
+/*
+  Pull-push hole filling for the samples image. Compiled twice: with
+  PULL, each invocation reduces 2x2 texels of a level into 1 texel of
+  the next, coarser level; with PUSH, each invocation fills an empty
+  texel of a level from the coarser level above it. Running pulls up
+  the pyramid and then pushes back down fills gaps between sparse
+  points with the surface around them.
+*/
+
+layout (local_size_x = 8, local_size_y = 8, local_size_z = 1) in;
+
+//Pull: the finer level. Push: the coarser level.
+layout (r32ui, binding = 3) readonly uniform uimage2D source;
+
+#ifdef PUSH
+layout (r32ui, binding = 4) uniform uimage2D target;
+#else
+layout (r32ui, binding = 4) writeonly uniform uimage2D target;
+#endif
+
+//Not imageSize(), for the same reason as in the other shaders
+layout (location = 6) uniform uvec2 sourceXY;
+layout (location = 7) uniform uvec2 targetXY;
+
+//How far behind the nearest sample (as a fraction of its depth) a
+//sample can be while still counting as the same surface.
+#ifndef DEPTH_TOLERANCE
+#define DEPTH_TOLERANCE 0.05
+#endif
+
+//Samples are ~0 - depth (see surfelsToSamples), so 0 is empty.
+float getDepth(uint value)
+{
+   return float(~0u - value);
+}
+
+uint getValue(float depth)
+{
+   return ~0u - uint(depth);
+}
+
+bool sameSurface(uint surface, uint value)
+{
+   float surfaceDepth = getDepth(surface);
+
+   return (value != 0u) &&
+      (abs(getDepth(value) - surfaceDepth) <= surfaceDepth * DEPTH_TOLERANCE);
+}
+
+uint loadSource(ivec2 coords)
+{
+   //Past the size in use there may be old data (see class image)
+   if (any(greaterThanEqual(uvec2(coords), sourceXY))) { return 0u; }
+
+   return imageLoad(source, coords).r;
+}
+
+/*
+  Average the depths of those of 4 values which are on the same
+  surface, so that an edge doesn't blend a foreground surface with
+  what's behind it. The surface chosen is the one with the most weight
+  among the 4, the nearest on a tie; that way a lone stray point
+  doesn't spread over its whole neighbourhood as it goes up the
+  pyramid.
+*/
+uint blendSurface(uint values[4], float weights[4])
+{
+   uint surface = 0u;
+   float surfaceWeight = 0.0;
+
+   for (int i = 0; i < 4; ++i)
+   {
+      if (values[i] == 0u) { continue; }
+
+      float weight = 0.0;
+
+      for (int j = 0; j < 4; ++j)
+      {
+	 if (sameSurface(values[i], values[j])) { weight += weights[j]; }
+      }
+
+      if ((weight > surfaceWeight) ||
+	  ((weight == surfaceWeight) && (values[i] > surface)))
+      {
+	 surface = values[i];
+	 surfaceWeight = weight;
+      }
+   }
+
+   if (surface == 0u) { return 0u; }
+
+   //Possible if the surface has no weight; settle for it
+   if (surfaceWeight == 0.0) { return surface; }
+
+   float depth = 0.0;
+
+   for (int i = 0; i < 4; ++i)
+   {
+      if (sameSurface(surface, values[i]))
+      {
+	 depth += getDepth(values[i]) * weights[i];
+      }
+   }
+
+   return getValue(depth / surfaceWeight);
+}
+
+void main()
+{
+   const ivec2 coords = ivec2(gl_GlobalInvocationID.xy);
+
+   if (any(greaterThanEqual(uvec2(coords), targetXY))) { return; }
+
+   uint values[4];
+   float weights[4];
+
+#ifdef PUSH
+   uint value = imageLoad(target, coords).r;
+
+   //Only fill holes; anything already there was actually rendered.
+   if (value != 0u) { return; }
+
+   //Bilinear weights for the 4 nearest coarser texels. The centre of
+   //this texel in the coarser level's coords is (coords + 0.5) / 2.
+   vec2 coarse = (vec2(coords) + 0.5) * 0.5 - 0.5;
+   ivec2 base = ivec2(floor(coarse));
+   vec2 f = coarse - vec2(base);
+
+   values[0] = loadSource(base);
+   values[1] = loadSource(base + ivec2(1, 0));
+   values[2] = loadSource(base + ivec2(0, 1));
+   values[3] = loadSource(base + ivec2(1, 1));
+
+   weights[0] = (1.0 - f.x) * (1.0 - f.y);
+   weights[1] = f.x * (1.0 - f.y);
+   weights[2] = (1.0 - f.x) * f.y;
+   weights[3] = f.x * f.y;
+
+   uint filled = blendSurface(values, weights);
+
+   if (filled != 0u)
+   {
+      imageStore(target, coords, uvec4(filled));
+   }
+#else
+   ivec2 base = coords * 2;
+
+   values[0] = loadSource(base);
+   values[1] = loadSource(base + ivec2(1, 0));
+   values[2] = loadSource(base + ivec2(0, 1));
+   values[3] = loadSource(base + ivec2(1, 1));
+
+   for (int i = 0; i < 4; ++i) { weights[i] = 1.0; }
+
+   imageStore(target, coords, uvec4(blendSurface(values, weights)));
+#endif
+}
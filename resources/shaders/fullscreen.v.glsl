@@ -0,0 +1,14 @@
+#version 430
+
+/*
+  One triangle covering the whole viewport (and then some), for
+  fragment shaders that work per pixel. Drawn as 3 vertices with no
+  buffers; the corners come from the vertex IDs:
+  (-1, -1), (3, -1) and (-1, 3).
+*/
+void main()
+{
+   vec2 corner = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+
+   gl_Position = vec4(corner * 2.0 - 1.0, 0.0, 1.0);
+}
@@ -1,44 +1,140 @@
 #version 430
 
-layout (local_size_x = 1024, local_size_y = 1, local_size_z = 1) in;
+/*
+  With PRESENT, this is a fragment shader instead, drawn over the
+  window (see fullscreen.v.glsl): each pixel goes straight to the
+  window's framebuffer, rather than to the pixels image to be blitted
+  there.
+*/
+#ifndef PRESENT
+#define PRESENT 0
+#endif
+
+#if !PRESENT
+//Normally #defined by the program, as tuned for the GPU (see
+//kernelTuner); these are just fallbacks.
+#ifndef LOCAL_SIZE_X
+#define LOCAL_SIZE_X 1024
+#endif
+
+#ifndef LOCAL_SIZE_Y
+#define LOCAL_SIZE_Y 1
+#endif
+
+layout (local_size_x = LOCAL_SIZE_X, local_size_y = LOCAL_SIZE_Y, local_size_z = 1) in;
+#endif
 
 //layout (rgba8ui, binding = 1) readonly uniform uimage2D samples;
 layout (r32ui, binding = 1) readonly uniform uimage2D samples;
 
+#if PRESENT
+layout (location = 0) out vec4 fragColour;
+#else
 //The final image
 layout (binding = 2) writeonly uniform uimage2D pixels;
+#endif
 
 layout (location = 5) uniform uvec2 pixelsXY;
 
+//The part of the samples image in use; the texture may be bigger
+layout (location = 7) uniform uvec2 samplesXY;
+
+//Resolve filters. FILTER and SUPERSAMPLE are normally #defined by the
+//program (see options.hpp); these are just fallbacks.
+#define FILTER_NONE 0
+#define FILTER_BOX 1
+#define FILTER_TENT 2
+
+#ifndef FILTER
+#define FILTER FILTER_BOX
+#endif
+
+//Samples per pixel along each axis. Needn't be an integer.
+#ifndef SUPERSAMPLE
+#define SUPERSAMPLE 2.0
+#endif
+
+//Average each pixel over frames, each of which draws a different part
+//of every sample (see renderer::jitter()).
+#ifndef TEMPORAL
+#define TEMPORAL 0
+#endif
+
+#if TEMPORAL
+//The average so far, then the plain frame drawn first after a reset,
+//0-255
+layout (rg32f, binding = 5) uniform image2D history;
+
+//This frame's share of the average: 1 for the first, 0 once it's
+//settled
+layout (location = 6) uniform float historyWeight;
+
+//How much of what's shown is the average, rather than the plain
+//frame; 0 for the plain frame itself
+layout (location = 8) uniform float historyShown;
+#endif
+
 uvec4 samp(ivec2 imageCoords)
 {
    /*
-     Currently keeping it simple and just doing a pattern of samples,
-     without weighting based on subpixel location, etc.
-
-     Let's say for simplicity there are just 4x samples.
      imageCoords are specifically coords for the final image, not the
-     samples buffer. Hence x2 below.
+     samples buffer. Hence * SUPERSAMPLE below.
    */
 
-   uvec4 mix = uvec4(0.0);
-
-   ivec2 baseCoords = imageCoords * 2;
-
-   mix += imageLoad(samples, baseCoords) / 4;
-   mix += imageLoad(samples, ivec2(baseCoords.x + 1, baseCoords.y)) / 4;
-   mix += imageLoad(samples, baseCoords + 1) / 4;
-   mix += imageLoad(samples, ivec2(baseCoords.x, baseCoords.y + 1)) / 4;
-
-   return mix;
+#if FILTER == FILTER_NONE
+   //1x: one sample per pixel, so nothing to filter.
+   return imageLoad(samples, imageCoords);
+#else
+   //The pixel's footprint in the samples image. With a non-integer
+   //factor its edges fall partway into samples.
+   vec2 low = vec2(imageCoords) * SUPERSAMPLE;
+   vec2 high = low + SUPERSAMPLE;
+
+#if FILTER == FILTER_TENT
+   //The tent reaches halfway into the neighbouring pixels.
+   const vec2 centre = (low + high) * 0.5;
+
+   low -= SUPERSAMPLE * 0.5;
+   high += SUPERSAMPLE * 0.5;
+#endif
+
+   //Past the image's edges, there are no samples to weigh at all (and
+   //counting them as 0 would darken the border)
+   ivec2 first = max(ivec2(floor(low)), ivec2(0));
+   ivec2 last = min(ivec2(ceil(high)) - 1, ivec2(samplesXY) - 1);
+
+   //Accumulate in float, since the weights aren't fractions of a
+   //power of 2.
+   vec4 mix = vec4(0.0);
+   float totalWeight = 0.0;
+
+   for (int y = first.y; y <= last.y; ++y)
+   {
+      for (int x = first.x; x <= last.x; ++x)
+      {
+#if FILTER == FILTER_TENT
+	 vec2 offset = abs(vec2(x, y) + 0.5 - centre) / SUPERSAMPLE;
+	 vec2 weights = max(vec2(1.0) - offset, vec2(0.0));
+#else
+	 //How much of the sample is covered by the pixel
+	 vec2 weights = (min(vec2(x + 1, y + 1), high) -
+			 max(vec2(x, y), low));
+#endif
+
+	 float weight = weights.x * weights.y;
+
+	 mix += vec4(imageLoad(samples, ivec2(x, y))) * weight;
+	 totalWeight += weight;
+      }
+   }
+
+   return uvec4(mix / totalWeight);
+#endif
 }
 
-void main()
+//The pixel's value, 0-255
+uint resolve(ivec2 coords)
 {
-   //In this shader each invocation should be assigned a specific
-   //pixel (like a fragment shader with a fragment).
-   const ivec2 coords = ivec2 (gl_GlobalInvocationID.xy);
-
    //imageLoad can only return uvec4, so have to reconstruct single
    //value.
    //(Just storing it direct won't work- lower-significance colours
@@ -58,9 +154,41 @@ void main()
 
 //   float scaledValue = float(recValue) * scale;
 
-   uint finalValue = uint(float(colour.r) * scale);
+   float value = float(colour.r) * scale;
+
+#if TEMPORAL
+   vec2 kept = vec2(value);
+
+   if (historyShown > 0.0)
+   {
+      kept = imageLoad(history, coords).rg;
+      kept.r = mix(kept.r, value, historyWeight);
+   }
+
+   imageStore(history, coords, vec4(kept, 0.0, 0.0));
+
+   value = mix(kept.g, kept.r, historyShown);
+#endif
+
+   return uint(value);
+}
+
+void main()
+{
+#if PRESENT
+   //Window coordinates are of pixels' centres
+   uint finalValue = resolve(ivec2(gl_FragCoord.xy));
+
+   fragColour = vec4(vec3(float(finalValue) / 255.0), 1.0);
+#else
+   //In this shader each invocation should be assigned a specific
+   //pixel (like a fragment shader with a fragment).
+   const ivec2 coords = ivec2 (gl_GlobalInvocationID.xy);
+
+   uint finalValue = resolve(coords);
    
    imageStore(pixels,
 	      coords,
 	      uvec4(finalValue, finalValue, finalValue, 255));
+#endif
 }
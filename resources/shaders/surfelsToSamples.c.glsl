@@ -1,20 +1,156 @@
 #version 430
 
+/*
+  LOCAL_SIZE_X and POINTS_PER_INVOCATION are normally #defined by the
+  program, as tuned for the GPU (see kernelTuner); these are just
+  fallbacks. Each invocation draws POINTS_PER_INVOCATION surfels.
+*/
+#ifndef LOCAL_SIZE_X
+#define LOCAL_SIZE_X 64
+#endif
+
+#ifndef POINTS_PER_INVOCATION
+#define POINTS_PER_INVOCATION 1
+#endif
+
 //1D on the basis that the buffer is 1D
-layout(local_size_x = 64, local_size_y = 1, local_size_z = 1) in;
+layout(local_size_x = LOCAL_SIZE_X, local_size_y = 1, local_size_z = 1) in;
 
+//xyz, then radius (0 if the model gave none)
 layout (std430, binding = 3) buffer surfelsBlock
 {
    vec4 data[];
 } surfels;
 
-uniform mat4 perspective;
+/*
+  Multiple views: with VIEWS over 1, each surfel is drawn by every one
+  of VIEWS cameras, into strips of the samples image side by side, the
+  first on the left. Each surfel's only read once for all of them.
+*/
+#ifndef VIEWS
+#define VIEWS 1
+#endif
+
+//Explicit locations, so they stay put between variants. The views
+//take VIEWS locations, so they come after everything else.
+#if VIEWS > 1
+layout (location = 8) uniform mat4 views[VIEWS];
+#else
+layout (location = 0) uniform mat4 perspective;
+#endif
 
 layout (r32ui, binding = 1) uniform uimage2D samples;
 
 //Not imageSize() because of dubious resizing technique - see class image
 layout (location = 3) uniform uvec2 samplesXY;
 
+/*
+  Splatting: with SPLAT, each surfel covers a disc of samples as wide
+  as its radius looks at its depth, instead of a single sample. Up to
+  MAX_SPLAT_RADIUS samples either side of the centre; past that,
+  points are near enough that there should be others filling in
+  around them anyway.
+*/
+#ifndef SPLAT
+#define SPLAT 0
+#endif
+
+#ifndef MAX_SPLAT_RADIUS
+#define MAX_SPLAT_RADIUS 4
+#endif
+
+/*
+  Culling: with a CLUSTER_SIZE, each workgroup draws one cluster (that
+  many surfels in a row) from a list left by cullClusters, rather than
+  each invocation drawing the surfel at its global index.
+*/
+#ifndef CLUSTER_SIZE
+#define CLUSTER_SIZE 0
+#endif
+
+#if CLUSTER_SIZE
+layout (std430, binding = 5) readonly buffer visibleBlock
+{
+   uint groups[3];
+   uint count;
+   uint ids[];
+} visible;
+#endif
+
+/*
+  Scenes: with SCENE, the surfels buffer is an arena of many models,
+  and each of a table of instances places one of them in the world.
+  The dispatch covers every instance's surfels in turn; each surfel
+  is found in the arena through the instance its index falls in.
+*/
+#ifndef SCENE
+#define SCENE 0
+#endif
+
+#if SCENE
+struct instance
+{
+   //Model to world
+   mat4 transform;
+
+   //Its surfels in the arena, and where they start among all the
+   //instances'
+   uint first;
+   uint count;
+   uint start;
+
+   //For the radii the model gives
+   float scale;
+};
+
+layout (std430, binding = 8) readonly buffer instancesBlock
+{
+   instance list[];
+} instances;
+
+//The last instance starting at or before index; they're in order
+uint findInstance(uint index)
+{
+   uint low = 0;
+   uint high = uint(instances.list.length()) - 1;
+
+   while (low < high)
+   {
+      uint middle = (low + high + 1) / 2;
+
+      if (instances.list[middle].start <= index) { low = middle; }
+      else { high = middle - 1; }
+   }
+
+   return low;
+}
+#endif
+
+/*
+  Temporal accumulation: with TEMPORAL, a frame only draws the points
+  that land in the middle of a sample, in a square footprint samples
+  wide (all of them, with a footprint of 1). The program moves the
+  camera by part of a sample each frame, so over enough frames every
+  part of every sample is drawn once - as each would be, into a sample
+  of its own, by supersampling. Splats cover area anyway, so they're
+  drawn whole.
+*/
+#ifndef TEMPORAL
+#define TEMPORAL 0
+#endif
+
+#if TEMPORAL && !SPLAT
+layout (location = 6) uniform float footprint;
+#endif
+
+#if SPLAT
+//Samples per world unit at a depth of 1
+layout (location = 4) uniform float radiusScale;
+
+//For surfels without a radius of their own
+layout (location = 5) uniform float surfelRadius;
+#endif
+
 uint get1DGlobalIndex()
 {
    /*
@@ -36,7 +172,18 @@ uint get1DGlobalIndex()
    return base + gl_LocalInvocationIndex;
 }
 
-ivec2 getWindowCoords(vec2 ndc)
+//A view's strip of the samples image: the column it starts at, and
+//how many it's wide
+uvec2 getStrip(uint view)
+{
+   uint left = view * samplesXY.x / VIEWS;
+   uint right = (view + 1) * samplesXY.x / VIEWS;
+
+   return uvec2(left, right - left);
+}
+
+//Within a strip stripXY in size
+ivec2 getWindowCoords(vec2 ndc, uvec2 stripXY)
 {
    /*
      Note input must be vec2, not ivec2.
@@ -44,7 +191,7 @@ ivec2 getWindowCoords(vec2 ndc)
      multiplying will make them -1, 0 or 1.
    */
 
-   vec2 halfDimensions = vec2(samplesXY / 2);
+   vec2 halfDimensions = vec2(stripXY / 2);
 
    /*
      [-1,1] * halfDimensions = [-halfDimensions,halfDimensions]
@@ -55,13 +202,46 @@ ivec2 getWindowCoords(vec2 ndc)
    return ivec2(coords);
 }
 
-void main()
+#if SPLAT
+//Only into the columns from left to right (exclusive)
+void splat(ivec2 centre, float radius, uint value, uint left, uint right)
+{
+   //Radius in samples; anything under half a sample is just the one.
+   int reach = min(int(radius + 0.5), MAX_SPLAT_RADIUS);
+
+   float radiusSquared = max(radius * radius, 0.25);
+
+   for (int y = -reach; y <= reach; ++y)
+   {
+      for (int x = -reach; x <= reach; ++x)
+      {
+	 ivec2 coords = centre + ivec2(x, y);
+
+	 //The image can be bigger than the part in use; don't spill
+	 //into the rest, since it isn't cleared - or into other views.
+	 if (float(x * x + y * y) > radiusSquared ||
+	     any(lessThan(coords, ivec2(left, 0))) ||
+	     any(greaterThanEqual(uvec2(coords), uvec2(right, samplesXY.y))))
+	 {
+	    continue;
+	 }
+
+	 imageAtomicMax(samples, coords, value);
+      }
+   }
+}
+#endif
+
+//data as read from the surfels buffer, by the view'th camera
+void drawInView(vec4 data, mat4 transform, uint view)
 {
-   vec4 data = surfels.data[get1DGlobalIndex()];
+   uvec2 strip = getStrip(view);
+   uvec2 stripXY = uvec2(strip.y, samplesXY.y);
 
    //Transform point
-   //Note must be a vec4 ending in 1.0 for matrix multiplication to work.
-   vec4 point = perspective * data;
+   //Note must be a vec4 ending in 1.0 for matrix multiplication to
+   //work (data.w is the radius).
+   vec4 point = transform * vec4(data.xyz, 1.0);
 
    //Perspective divide -> normalised device coords
    vec4 ndc = point / point.w;
@@ -72,11 +252,104 @@ void main()
    //Flip z (for purposes of atomicMax)
    uint value = ~0 - uint(point.w);
 
-   ivec2 coords = getWindowCoords(ndc.xy);
-   
+   ivec2 coords = getWindowCoords(ndc.xy, stripXY);
+
+#if VIEWS > 1
+   //Off the side of this view would be in the next one's strip
+   dscrd = dscrd || (coords.x < 0) || (coords.x >= int(strip.y));
+
+   coords.x += int(strip.x);
+#endif
+
+#if SPLAT
+   if (dscrd) { return; }
+
+   float radius = (data.w > 0.0) ? data.w : surfelRadius;
+
+   splat(coords, radius * radiusScale / point.w, value, strip.x, strip.x + strip.y);
+#else
+#if TEMPORAL
+   //Where in its sample the point is, as in getWindowCoords()
+   vec2 within = abs(fract(vec2(stripXY / 2) * (ndc.xy + 1)) - 0.5);
+
+   dscrd = dscrd || any(greaterThan(within, vec2(footprint * 0.5)));
+#endif
+
    //Depth followed by rgb
    imageAtomicMax(samples,
 //		  coords,
 		  dscrd? ivec2(-1, -1) : coords,
 		  value);
+#endif
+}
+
+void drawSurfel(uint index)
+{
+#if SCENE
+   uint last = uint(instances.list.length()) - 1;
+
+   //The last workgroup can run past the last instance
+   if (index >= instances.list[last].start + instances.list[last].count) { return; }
+
+   uint placed = findInstance(index);
+
+   vec4 data = surfels.data[instances.list[placed].first + index - instances.list[placed].start];
+
+   //Into the world; a radius of 0 is still none
+   data = vec4((instances.list[placed].transform * vec4(data.xyz, 1.0)).xyz,
+	       data.w * instances.list[placed].scale);
+#else
+   //The last workgroup (or cluster) can run past the end
+   if (index >= uint(surfels.data.length())) { return; }
+
+   vec4 data = surfels.data[index];
+#endif
+
+#if VIEWS > 1
+   for (uint view = 0; view < VIEWS; ++view)
+   {
+      drawInView(data, views[view], view);
+   }
+#else
+   drawInView(data, perspective, 0);
+#endif
+}
+
+void main()
+{
+#if CLUSTER_SIZE
+   //Workgroups wrap into y past the maximum in x
+   uint slot = gl_WorkGroupID.y * gl_NumWorkGroups.x + gl_WorkGroupID.x;
+
+   if (slot >= visible.count) { return; }
+
+   uint first = visible.ids[slot] * CLUSTER_SIZE;
+
+   for (uint i = gl_LocalInvocationIndex; i < CLUSTER_SIZE; i += gl_WorkGroupSize.x)
+   {
+      drawSurfel(first + i);
+   }
+#else
+   /*
+     Each workgroup covers POINTS_PER_INVOCATION times as many surfels
+     as it has invocations. They step through them a workgroup's width
+     at a time, so neighbouring invocations still read neighbouring
+     surfels.
+   */
+   uint groupSize = gl_WorkGroupSize.x * gl_WorkGroupSize.y * gl_WorkGroupSize.z;
+
+#if SCENE
+   //Workgroups wrap into y past the maximum in x (see surfelScene)
+   uint groupBase = (gl_WorkGroupID.y * gl_NumWorkGroups.x + gl_WorkGroupID.x) * groupSize;
+#else
+   uint groupBase = get1DGlobalIndex() - gl_LocalInvocationIndex;
+#endif
+
+   uint first = groupBase * POINTS_PER_INVOCATION + gl_LocalInvocationIndex;
+
+   for (uint i = 0; i < POINTS_PER_INVOCATION; ++i)
+   {
+      drawSurfel(first + i * groupSize);
+   }
+#endif
 }
@@ -0,0 +1,285 @@
+#include "../lib/glad/include/glad/glad.h"
+
+#include "benchmark.hpp"
+#include "gpuProfiler.hpp"
+
+#include <fstream>
+#include <iomanip>
+
+using namespace std;
+
+static const size_t histogramBuckets = 20;
+
+namespace
+{
+   //Escaped for a JSON string
+   string quoteJSON(const string& value)
+   {
+      string quoted = "\"";
+
+      for (char c : value)
+      {
+	 if ((c == '"') || (c == '\\')) { quoted += '\\'; quoted += c; }
+
+	 else if ((unsigned char) c < 0x20)
+	 {
+	    char escape[8];
+	    snprintf(escape, sizeof(escape), "\\u%04x", (unsigned int) c);
+
+	    quoted += escape;
+	 }
+
+	 else { quoted += c; }
+      }
+
+      return quoted + "\"";
+   }
+}
+
+benchmark::benchmark(bool enable, size_t maxFrames, double maxSeconds)
+   : slotFrames (timestampRing::ringSize, 0)
+   , maxFrames (maxFrames)
+   , maxSeconds (maxSeconds)
+   , numFrames (0)
+   , runSeconds (0.0)
+   , enabled (enable)
+{
+   if (enabled) { ring.prep(1); }
+}
+
+void benchmark::read(GLuint slot)
+{
+   gpuTimes[slotFrames[slot]] = ring.getMs(slot, 0);
+}
+
+void benchmark::beginFrame()
+{
+   frameBegun = clock::now();
+
+   if (!numFrames) { runBegun = frameBegun; frameEnded = frameBegun; }
+
+   if (!enabled) { return; }
+
+   timestampRing::reader reader = [this](GLuint slot) { read(slot); };
+
+   ring.collect(reader);
+
+   //No frame's skipped: its slot's from ringSize frames ago, so it's
+   //long done anyway
+   if (!ring.beginFrame())
+   {
+      ring.collect(reader, true);
+      ring.beginFrame();
+   }
+
+   slotFrames[ring.getCurrent()] = cpuTimes.size();
+
+   ring.stamp(0, true);
+}
+
+void benchmark::endFrame()
+{
+   ++numFrames;
+
+   clock::time_point now = clock::now();
+
+   double sinceLast = chrono::duration<double, milli>(now - frameEnded).count();
+
+   frameEnded = now;
+
+   if (!enabled) { return; }
+
+   ring.stamp(0, false);
+   ring.endFrame();
+
+   cpuTimes.push_back(chrono::duration<double, milli>(now - frameBegun).count());
+   gpuTimes.push_back(0.0);
+   frameTimes.push_back(sinceLast);
+
+   LOG_GL();
+}
+
+bool benchmark::done() const
+{
+   if (maxFrames && (numFrames >= maxFrames)) { return true; }
+
+   if ((maxSeconds > 0.0) && numFrames)
+   {
+      return chrono::duration<double>(clock::now() - runBegun).count() >= maxSeconds;
+   }
+
+   return false;
+}
+
+void benchmark::finish()
+{
+   if (!enabled) { return; }
+
+   glFinish();
+
+   runSeconds = chrono::duration<double>(clock::now() - runBegun).count();
+
+   ring.collect([this](GLuint slot) { read(slot); }, true);
+
+   LOG_GL();
+}
+
+benchmark::timeStats benchmark::getStats(const vector<double>& times)
+{
+   timeStats stats;
+
+   double sum = 0.0;
+   stats.max = 0.0;
+
+   for (double time : times)
+   {
+      sum += time;
+
+      if (time > stats.max) { stats.max = time; }
+   }
+
+   stats.avg = sum / times.size();
+   stats.p50 = getPercentile(times, 0.5);
+   stats.p95 = getPercentile(times, 0.95);
+   stats.p99 = getPercentile(times, 0.99);
+
+   return stats;
+}
+
+vector<size_t> benchmark::getHistogram(double& bucketMs) const
+{
+   vector<size_t> counts(histogramBuckets, 0);
+
+   double longest = getStats(frameTimes).max;
+
+   bucketMs = (longest > 0.0) ? longest / histogramBuckets : 1.0;
+
+   for (double time : frameTimes)
+   {
+      size_t bucket = (size_t) (time / bucketMs);
+
+      //The longest lands on the last bucket's upper edge
+      counts[min(bucket, counts.size() - 1)] += 1;
+   }
+
+   return counts;
+}
+
+void benchmark::report(size_t pointsPerFrame) const
+{
+   if (!enabled || !cpuTimes.size()) { return; }
+
+   size_t numTimed = cpuTimes.size();
+
+   cout << numTimed << " frames in " << runSeconds << "s: "
+	<< (double) numTimed / runSeconds << " fps, "
+	<< (double) pointsPerFrame * (double) numTimed / runSeconds
+	<< " points/s\n"
+	<< "  ms              avg    p50    p95    p99    max\n";
+
+   const vector<double>* times[3] = {&frameTimes, &cpuTimes, &gpuTimes};
+   const char* names[3] = {"frame", "cpu submit", "gpu execute"};
+
+   for (int i = 0; i < 3; ++i)
+   {
+      timeStats stats = getStats(*times[i]);
+
+      cout << "  " << left << setw(12) << names[i] << right << fixed << setprecision(3)
+	   << setw(7) << stats.avg
+	   << setw(7) << stats.p50
+	   << setw(7) << stats.p95
+	   << setw(7) << stats.p99
+	   << setw(7) << stats.max << '\n';
+   }
+
+   double bucketMs;
+   vector<size_t> counts = getHistogram(bucketMs);
+
+   size_t most = 0;
+   for (size_t count : counts) { most = max(most, count); }
+
+   //Bars scaled to the fullest bucket
+   const size_t barWidth = 40;
+
+   cout << "  frame times, ms:\n";
+
+   for (size_t bucket = 0; bucket < counts.size(); ++bucket)
+   {
+      cout << "  " << setw(8) << bucket * bucketMs << "-" << setw(8) << (bucket + 1) * bucketMs
+	   << " " << setw(6) << counts[bucket] << " "
+	   << string(most ? counts[bucket] * barWidth / most : 0, '#') << '\n';
+   }
+
+   cout << defaultfloat << setprecision(6) << flush;
+}
+
+bool benchmark::writeJSON(const string& fileName, size_t pointsPerFrame,
+			  const map<string, string>& settings) const
+{
+   if (!enabled || !cpuTimes.size()) { return false; }
+
+   ofstream file;
+   file.open(fileName, ofstream::out | ofstream::trunc);
+
+   if (!file.is_open())
+   {
+      cerr << "Couldn't write benchmark results to \"" << fileName << "\"" << endl;
+
+      return false;
+   }
+
+   const deviceCapabilities& caps = getDeviceCapabilities();
+
+   size_t numTimed = cpuTimes.size();
+
+   file << "{\n"
+	<< "  \"device\": {\"vendor\": " << quoteJSON(caps.vendor)
+	<< ", \"renderer\": " << quoteJSON(caps.renderer)
+	<< ", \"version\": " << quoteJSON(caps.version) << "},\n"
+	<< "  \"settings\": {";
+
+   bool first = true;
+
+   for (auto& setting : settings)
+   {
+      file << (first ? "" : ", ") << quoteJSON(setting.first) << ": " << quoteJSON(setting.second);
+
+      first = false;
+   }
+
+   file << "},\n"
+	<< "  \"frames\": " << numTimed << ",\n"
+	<< "  \"seconds\": " << runSeconds << ",\n"
+	<< "  \"fps\": " << (double) numTimed / runSeconds << ",\n"
+	<< "  \"points_per_second\": "
+	<< (double) pointsPerFrame * (double) numTimed / runSeconds << ",\n";
+
+   const vector<double>* times[3] = {&frameTimes, &cpuTimes, &gpuTimes};
+   const char* names[3] = {"frame_ms", "cpu_submit_ms", "gpu_execute_ms"};
+
+   for (int i = 0; i < 3; ++i)
+   {
+      timeStats stats = getStats(*times[i]);
+
+      file << "  \"" << names[i] << "\": {\"avg\": " << stats.avg
+	   << ", \"p50\": " << stats.p50
+	   << ", \"p95\": " << stats.p95
+	   << ", \"p99\": " << stats.p99
+	   << ", \"max\": " << stats.max << "},\n";
+   }
+
+   double bucketMs;
+   vector<size_t> counts = getHistogram(bucketMs);
+
+   file << "  \"frame_ms_histogram\": {\"bucket_ms\": " << bucketMs << ", \"counts\": [";
+
+   for (size_t bucket = 0; bucket < counts.size(); ++bucket)
+   {
+      file << (bucket ? ", " : "") << counts[bucket];
+   }
+
+   file << "]}\n"
+	<< "}\n";
+
+   return (bool) file;
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "compute.hpp"
+#include "gpuProfiler.hpp"
+
+#include <chrono>
+
+class benchmark
+/*
+  Times every frame of a run, for comparing one run with another: CPU
+  submit time (from starting a frame to having submitted all of it),
+  GPU execute time (between timestamps at either end of it) and frame
+  time (from the end of one frame to the end of the next, as seen by
+  the CPU). As in gpuProfiler, the timestamps are read back some frames
+  later; but no frame is ever skipped, since a run is only comparable
+  as a whole. Its ring just has to be deeper than the frames in
+  flight, so reading a slot back never has to wait.
+
+  It also says when a run of some number of frames, or seconds, is
+  over - whether or not it's timing anything.
+*/
+{
+private:
+   typedef std::chrono::steady_clock clock;
+
+   struct timeStats
+   {
+      double avg, p50, p95, p99, max;
+   };
+
+   //Just the whole frame (see timestampRing)
+   timestampRing ring;
+   //Of the frame in each slot
+   std::vector<size_t> slotFrames;
+
+   //Milliseconds, per frame
+   std::vector<double> cpuTimes;
+   std::vector<double> gpuTimes;
+   std::vector<double> frameTimes;
+
+   //0 for no limit
+   size_t maxFrames;
+   double maxSeconds;
+   size_t numFrames;
+
+   clock::time_point runBegun;
+   clock::time_point frameBegun;
+   clock::time_point frameEnded;
+   double runSeconds;
+
+   bool enabled;
+
+   //Of a frame whose results are in (see timestampRing::collect())
+   void read(GLuint slot);
+
+   static timeStats getStats(const std::vector<double>& times);
+
+   //Equal-width buckets of frame times, from 0 to the longest
+   std::vector<size_t> getHistogram(double& bucketMs) const;
+
+public:
+   benchmark(bool enable, size_t maxFrames = 0, double maxSeconds = 0.0);
+
+   void beginFrame();
+   void endFrame();
+
+   //Whether the run's limit has been reached
+   bool done() const;
+   size_t getNumFrames() const { return numFrames; }
+
+   //Waits for the last frames; call once after them
+   void finish();
+
+   /*
+     Frame rate, points drawn per second (given pointsPerFrame), and
+     the average, percentiles and maximum of each time, with a
+     histogram of frame times.
+   */
+   void report(size_t pointsPerFrame) const;
+
+   //The same, as JSON; settings (e.g. the options used) go in as
+   //they are, as strings.
+   bool writeJSON(const std::string& fileName, size_t pointsPerFrame,
+		  const std::map<std::string, std::string>& settings) const;
+};
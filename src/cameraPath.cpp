@@ -0,0 +1,89 @@
+#include "cameraPath.hpp"
+
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+
+using namespace std;
+
+void cameraPath::load(const string& fileName)
+{
+   ifstream file;
+   file.open(fileName, ifstream::in);
+
+   if (!file.is_open())
+   {
+      throw runtime_error("Couldn't read camera path \"" + fileName + "\"");
+   }
+
+   poses.clear();
+
+   string line;
+   size_t lineNumber = 0;
+
+   while (getline(file, line))
+   {
+      ++lineNumber;
+
+      if (!line.size() || (line[0] == '#')) { continue; }
+
+      istringstream values(line);
+
+      cameraPose pose;
+
+      geom::vec3* vecs[3] = {&pose.pos, &pose.dirZ, &pose.dirY};
+
+      for (geom::vec3* vec : vecs)
+      {
+	 for (int i = 0; i < 3; ++i) { values >> (*vec)[i]; }
+      }
+
+      if (!values)
+      {
+	 throw runtime_error("Bad pose on line " + to_string(lineNumber) +
+			     " of camera path \"" + fileName + "\"");
+      }
+
+      poses.push_back(pose);
+   }
+
+   if (!poses.size())
+   {
+      throw runtime_error("Camera path \"" + fileName + "\" has no poses");
+   }
+}
+
+bool cameraPath::save(const string& fileName) const
+{
+   ofstream file;
+   file.open(fileName, ofstream::out | ofstream::trunc);
+
+   if (!file.is_open())
+   {
+      cerr << "Couldn't write camera path \"" << fileName << "\"" << endl;
+
+      return false;
+   }
+
+   file << "# pos.xyz dirZ.xyz dirY.xyz, per frame\n";
+
+   //Enough to get the same floats back
+   file.precision(numeric_limits<float>::max_digits10);
+
+   for (const cameraPose& pose : poses)
+   {
+      const geom::vec3* vecs[3] = {&pose.pos, &pose.dirZ, &pose.dirY};
+
+      for (int v = 0; v < 3; ++v)
+      {
+	 for (int i = 0; i < 3; ++i)
+	 {
+	    file << (*vecs[v])[i] << (((v == 2) && (i == 2)) ? '\n' : ' ');
+	 }
+      }
+   }
+
+   return (bool) file;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include "projection.hpp"
+
+#include <string>
+#include <vector>
+
+class cameraPath
+/*
+  A camera pose for each frame of a run, so the same fly-through can
+  be replayed exactly - by another build, or with other options - and
+  their timings compared.
+
+  Files are text: a comment line, then a line per frame of the
+  position, Z axis and Y axis (9 numbers), written with enough digits
+  to read back exactly.
+*/
+{
+private:
+   std::vector<cameraPose> poses;
+
+public:
+   void record(const cameraPose& pose) { poses.push_back(pose); }
+
+   const cameraPose& getPose(size_t frame) const { return poses[frame]; }
+   size_t getNumFrames() const { return poses.size(); }
+
+   //Throws runtime_error if the file can't be read, or has no poses
+   void load(const std::string& fileName);
+   bool save(const std::string& fileName) const;
+};
@@ -5,9 +5,67 @@
 #include "pcdReader.hpp"
 #include "sdl_utils.hpp"
 
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
 // GL error reporting
 
-std::map<int, std::string> errorsGL;
+std::map<std::string, std::string> errorsGL;
+
+namespace
+{
+   bool debugOutputGL = false;
+
+   //Messages from the debug callback since the last LOG_GL()
+   std::vector<std::string> pendingErrorsGL;
+
+   //Only errors are let through (see prepDebugOutputGL()), so only the
+   //message matters
+   void APIENTRY receiveDebugMessageGL(GLenum, GLenum, GLuint, GLenum, GLsizei length,
+				       const GLchar* message, const void*)
+   {
+      pendingErrorsGL.push_back(length < 0 ?
+				std::string(message) :
+				std::string(message, length));
+   }
+}
+
+bool prepDebugOutputGL()
+{
+#ifdef GL_CHECKS
+   //Core since 4.3
+   if (!GLAD_GL_VERSION_4_3) { return false; }
+
+   glEnable(GL_DEBUG_OUTPUT);
+
+   //Called back from within the erroneous call, so that it's filed
+   //under the right site
+   glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+
+   glDebugMessageCallback(receiveDebugMessageGL, nullptr);
+
+   //Just errors, like glGetError() gives; not performance hints etc.
+   glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DONT_CARE,
+			 0, nullptr, GL_FALSE);
+   glDebugMessageControl(GL_DONT_CARE, GL_DEBUG_TYPE_ERROR, GL_DONT_CARE,
+			 0, nullptr, GL_TRUE);
+
+   debugOutputGL = true;
+
+   return true;
+#else
+   return false;
+#endif
+}
+
+void discardErrorsGL()
+{
+   while (glGetError() != GL_NO_ERROR) {}
+
+   pendingErrorsGL.clear();
+}
 
 std::string getErrorGL()
 {
@@ -46,40 +104,118 @@ void printErrorGL(const char* file, int line)
    }
 }
 
-void logErrorGL(int line)
+void logErrorGL(const char* file, int line)
 {
-   std::string err = getErrorGL();
+   std::string err;
 
-   //TODO? What if the error is different
+   if (debugOutputGL)
+   {
+      //Every one since the last site, as one call can raise several
+      for (const std::string& message : pendingErrorsGL)
+      {
+	 err += (err.size() ? "; " : "") + message;
+      }
+
+      pendingErrorsGL.clear();
+   }
+
+   else { err = getErrorGL(); }
 
    if (err.size())
    {
-      if (!errorsGL.count(line))
+      std::string site = std::string(file) + ":" + std::to_string(line);
+
+      if (!errorsGL.count(site))
       {
-	 errorsGL[line] = err;
+	 errorsGL[site] = err;
       }
    }
 }
 
 void printErrorsGL()
 {
-   for (auto& lineError : errorsGL)
+   for (auto& siteError : errorsGL)
    {
-      std::cerr << "GL error at line " << lineError.first << ": "
-		<< lineError.second << '\n';
+      std::cerr << "GL error at " << siteError.first << ": "
+		<< siteError.second << '\n';
+   }
+
+   //Since the last site
+   for (auto& err : pendingErrorsGL)
+   {
+      std::cerr << "GL error after the last check: " << err << '\n';
    }
 
    std::cerr << flush;
 }
 
-#define errorGL() printErrorGL(__FILE__, __LINE__)
-#define LOG_GL() logErrorGL(__LINE__)
+
+// Program binary cache
+
+string programCacheDir;
+
+programCacheStats programCacheTotals = {0, 0, 0.0, 0.0, 0.0};
+
+namespace
+{
+   const char programCacheMagic[8] = {'S', 'U', 'R', 'F', 'P', 'R', 'O', 'G'};
+
+   //FNV-1a; only has to tell sources apart, not resist anyone
+   uint64_t hashString(const string& text, uint64_t hash = 14695981039346656037ull)
+   {
+      for (unsigned char c : text)
+      {
+	 hash ^= c;
+	 hash *= 1099511628211ull;
+      }
+
+      return hash;
+   }
+
+   bool canCacheBinaries()
+   {
+      return (programCacheDir.size() &&
+	      (getDeviceCapabilities().numProgramBinaryFormats > 0));
+   }
+
+   double getMsSince(chrono::steady_clock::time_point start)
+   {
+      return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+   }
+
+   template <typename T>
+   bool readValue(istream& in, T& value)
+   {
+      return (bool) in.read((char*) &value, sizeof(T));
+   }
+
+   template <typename T>
+   void writeValue(ostream& out, const T& value)
+   {
+      out.write((const char*) &value, sizeof(T));
+   }
+}
+
+void printProgramCacheStats()
+{
+   const programCacheStats& stats = programCacheTotals;
+
+   if (!stats.numLoaded && !stats.numCompiled) { return; }
+
+   cout << "Programs: " << stats.numLoaded << " loaded from cache in "
+	<< stats.loadMs << "ms";
+
+   if (stats.numLoaded) { cout << " (saving ~" << stats.savedMs << "ms)"; }
+
+   cout << ", " << stats.numCompiled << " compiled in " << stats.compileMs << "ms" << endl;
+}
 
 //
 
-shader::shader(const string& nm)
+shader::shader(const string& nm, const shaderDefines& defs, GLenum shaderKind)
    : filename (nm)
-   , kind (GL_COMPUTE_SHADER)
+   , defines (defs)
+   , kind (shaderKind)
    , handle (0)
 {}
 
@@ -99,44 +235,28 @@ string shader::read()
    
    text.reserve(len);
    
-#if 0
-   /*
-     Proof of concept: work out workgroup sizes (within shader),
-     dynamically- have to, unless under the minimums.
-     The minimums expected are 1024 total, 1024/1024/64.
-
-     Note that this is not the same as the -number- of workgroups,
-     which has similar limits in place you have to check - and for
-     occupcancy's sake should depend on the dynamically-worked-out
-     sizes here.
-   */
-   
-   text += "#version 430\n";
-
-   GLint maxWkgpSizeTotal = -1;
-   glGetIntegerv(GL_MAX_COMPUTE_WORK_GROUP_INVOCATIONS, &maxWkgpsTotal);
+   string line;
 
-   GLint maxWkgpSizes[3];
+   bool definesAdded = !defines.size();
 
-   for (unsigned int i = 0; i < 3; ++i)
+   while (getline(file, line))
    {
-      glGetIntegerv(GL_MAX_COMPUTE_WORK_GROUP_SIZE, i, &maxWkgpSizes[i]);
-   }
-   
-   string wkgpX, wkgpY, wkgpZ;
-   
-   //TODO: work out workgroup dimensions
+      text += line + '\n';
 
-   text += "layout(local_size_x = " + wkgpX +
-      ", local_size_y = " + wkgpY +
-      ", local_size_z = " + wkgpZ + ") in;\n";
-#endif
+      //#version has to come first, so the defines go straight after
+      //it.
+      if (!definesAdded && !line.compare(0, 8, "#version"))
+      {
+	 for (auto& define : defines)
+	 {
+	    text += "#define " + define.first + " " + define.second + '\n';
+	 }
 
-   string line;
+	 //Keep line numbers in compile errors matching the file
+	 text += "#line 2\n";
 
-   while (getline(file, line))
-   {
-      text += line + '\n';
+	 definesAdded = true;
+      }
       
       continue;
    }
@@ -256,12 +376,25 @@ bool shader::prep(GLuint program)
 
 void shader::quit()
 {
+   //Can be called again, from the destructor, after program::quit()
    glDeleteShader(handle);
+
+   handle = 0;
 }
 
-program::program(const string& shaderNm)
+program::program(const string& shaderNm, const shaderDefines& defs)
+   : handle (0)
+   , mainShader (shaderNm, defs)
+   , vertexShader ("", defs, GL_VERTEX_SHADER)
+   , drawing (false)
+{ prep(); }
+
+program::program(const string& shaderNm, const shaderDefines& defs,
+		 const string& vertexShaderNm)
    : handle (0)
-   , compute (shaderNm)
+   , mainShader (shaderNm, defs, vertexShaderNm.size() ? GL_FRAGMENT_SHADER : GL_COMPUTE_SHADER)
+   , vertexShader (vertexShaderNm, defs, GL_VERTEX_SHADER)
+   , drawing (vertexShaderNm.size())
 { prep(); }
 
 program::~program() { quit(); }
@@ -288,9 +421,54 @@ string program::getLogGL()
 
 bool program::prep()
 {
+   auto start = chrono::steady_clock::now();
+
    handle = glCreateProgram();
 
-   compute.prep(handle);
+   string driverKey, cachePath;
+   uint64_t sourceHash = 0;
+
+   if (canCacheBinaries())
+   {
+      //Binaries are only good for the driver (and GPU) that made them
+      driverKey = getDeviceCapabilities().getDriverKey();
+      sourceHash = hashString(mainShader.read(), hashString(driverKey));
+
+      if (drawing) { sourceHash = hashString(vertexShader.read(), sourceHash); }
+
+      char name[32];
+      snprintf(name, sizeof(name), "/program-%016llx.bin",
+	       (unsigned long long) sourceHash);
+
+      cachePath = programCacheDir + name;
+
+      double compileMs = 0.0;
+
+      if (loadBinary(cachePath, driverKey, sourceHash, compileMs))
+      {
+	 double loadMs = getMsSince(start);
+
+	 programCacheTotals.numLoaded += 1;
+	 programCacheTotals.loadMs += loadMs;
+	 programCacheTotals.savedMs += max(compileMs - loadMs, 0.0);
+
+	 return true;
+      }
+
+      //A rejected binary can leave the program in a failed state;
+      //start again.
+      glDeleteProgram(handle);
+      handle = glCreateProgram();
+   }
+
+   mainShader.prep(handle);
+
+   if (drawing) { vertexShader.prep(handle); }
+
+   if (cachePath.size())
+   {
+      glProgramParameteri(handle, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+   }
 
    glLinkProgram(handle);
 
@@ -316,12 +494,127 @@ bool program::prep()
 
    //Validation? (TODO?)
 
+   double compileMs = getMsSince(start);
+
+   programCacheTotals.numCompiled += 1;
+   programCacheTotals.compileMs += compileMs;
+
+   if (cachePath.size()) { saveBinary(cachePath, driverKey, sourceHash, compileMs); }
+
    return true;
 }
 
+/*
+  Cache files are: the magic bytes, the source hash, the driver key
+  (length then chars), the binary's format, the compile time, then the
+  binary (length then bytes).
+*/
+bool program::loadBinary(const string& path, const string& driverKey,
+			 uint64_t sourceHash, double& compileMs)
+{
+   ifstream file;
+   file.open(path, ifstream::in | ifstream::binary);
+
+   if (!file.is_open()) { return false; }
+
+   char magic[sizeof(programCacheMagic)];
+   uint64_t fileHash = 0;
+   uint32_t keyLength = 0;
+
+   if (!file.read(magic, sizeof(magic)) ||
+       memcmp(magic, programCacheMagic, sizeof(magic)) ||
+       !readValue(file, fileHash) || (fileHash != sourceHash) ||
+       !readValue(file, keyLength) || (keyLength != driverKey.size()))
+   {
+      return false;
+   }
+
+   string fileKey(keyLength, '\0');
+
+   GLenum format = 0;
+   uint32_t length = 0;
+
+   if (!file.read(&fileKey[0], keyLength) || (fileKey != driverKey) ||
+       !readValue(file, format) || !readValue(file, compileMs) ||
+       !readValue(file, length))
+   {
+      return false;
+   }
+
+   vector<char> binary(length);
+
+   if (!file.read(binary.data(), length)) { return false; }
+
+   glProgramBinary(handle, format, binary.data(), (GLsizei) length);
+
+   //Fails if the driver changed without its version string doing so
+   GLint checkLink = 0;
+   glGetProgramiv(handle, GL_LINK_STATUS, &checkLink);
+
+   //Errors here just mean a stale binary; don't log them (nor leave
+   //them for the next site to).
+   discardErrorsGL();
+
+   return checkLink;
+}
+
+void program::saveBinary(const string& path, const string& driverKey,
+			 uint64_t sourceHash, double compileMs)
+{
+   GLint length = 0;
+   glGetProgramiv(handle, GL_PROGRAM_BINARY_LENGTH, &length);
+
+   if (length <= 0) { return; }
+
+   vector<char> binary(length);
+   GLenum format = 0;
+
+   glGetProgramBinary(handle, length, nullptr, &format, binary.data());
+
+   LOG_GL();
+
+   ofstream file;
+   file.open(path, ofstream::out | ofstream::binary | ofstream::trunc);
+
+   if (!file.is_open())
+   {
+      //Once is enough
+      static bool warned = false;
+
+      if (!warned)
+      {
+	 cerr << "Couldn't write program binaries to \"" << programCacheDir << "\"" << endl;
+
+	 warned = true;
+      }
+
+      return;
+   }
+
+   file.write(programCacheMagic, sizeof(programCacheMagic));
+   writeValue(file, sourceHash);
+   writeValue(file, (uint32_t) driverKey.size());
+   file.write(driverKey.data(), driverKey.size());
+   writeValue(file, format);
+   writeValue(file, compileMs);
+   writeValue(file, (uint32_t) length);
+   file.write(binary.data(), length);
+}
+
+bool program::rebuild(const shaderDefines& defs)
+{
+   quit();
+
+   mainShader.setDefines(defs);
+   vertexShader.setDefines(defs);
+
+   return prep();
+}
+
 void program::quit()
 {
-   compute.quit();
+   mainShader.quit();
+   vertexShader.quit();
    
    glDeleteProgram(handle);
 
@@ -335,6 +628,186 @@ void program::use()
 
 GLuint program::getHandle() { return handle; }
 
+// Texture pool
+
+namespace
+{
+   //Textures given back and kept for reuse, at most
+   const size_t maxSpareTextures = 4;
+
+   //How much more than they need images take when they grow, so
+   //dragging the window bigger doesn't replace them every frame
+   const float resizeHeadroom = 0.25f;
+
+   //The smallest size bucket that holds size: a power of two, or one
+   //and a half times one.
+   GLuint getBucketSize(GLuint size)
+   {
+      GLuint bucket = 64;
+
+      while (bucket < size)
+      {
+	 //Powers of two go to one and a half times them, and back
+	 bucket = (bucket & (bucket - 1)) ? (bucket / 3) * 4 : (bucket / 2) * 3;
+      }
+
+      return bucket;
+   }
+
+   GLuint getTexelBytes(GLenum format)
+   {
+      switch (format)
+      {
+      case GL_R8: return 1;
+      case GL_RG8: return 2;
+      case GL_RG32F:
+      case GL_RGBA16F: return 8;
+      case GL_RGBA32F: return 16;
+
+      //RGBA8, R32UI, R32F...
+      default: return 4;
+      }
+   }
+
+   void setFilter(GLuint handle, GLenum filter)
+   {
+      glBindTexture(GL_TEXTURE_2D, handle);
+
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+   }
+}
+
+texturePool::texturePool()
+   : numResizes (0)
+   , numReplaced (0)
+   , numCreated (0)
+   , numReused (0)
+   , numDeleted (0)
+   , bytesInUse (0)
+   , bytesSpare (0)
+   , peakBytes (0)
+{}
+
+size_t texturePool::getBytes(const pooledTexture& tex)
+{
+   size_t bytes = 0;
+
+   for (GLuint level = 0; level < tex.levels; ++level)
+   {
+      bytes += (size_t) std::max(tex.width >> level, 1u) * std::max(tex.height >> level, 1u);
+   }
+
+   return bytes * getTexelBytes(tex.format);
+}
+
+pooledTexture texturePool::acquire(GLenum format, GLuint width, GLuint height,
+				   GLuint levels, float headroom)
+{
+   GLuint maxSize = (GLuint) getDeviceCapabilities().maxTextureSize;
+
+   pooledTexture wanted;
+   wanted.format = format;
+
+   //Past the largest bucket the GL allows, just what's asked for
+   wanted.width = getBucketSize((GLuint) std::ceil(width * (1.f + headroom)));
+   wanted.height = getBucketSize((GLuint) std::ceil(height * (1.f + headroom)));
+
+   wanted.width = std::max(std::min(wanted.width, maxSize), width);
+   wanted.height = std::max(std::min(wanted.height, maxSize), height);
+
+   //A full chain for the size, at most
+   GLuint maxLevels = 1;
+   while ((std::max(wanted.width, wanted.height) >> maxLevels) > 0) { ++maxLevels; }
+
+   wanted.levels = std::max(std::min(levels, maxLevels), 1u);
+
+   size_t bytes = getBytes(wanted);
+
+   for (size_t i = 0; i < spare.size(); ++i)
+   {
+      const pooledTexture& tex = spare[i];
+
+      if ((tex.format == wanted.format) &&
+	  (tex.width == wanted.width) && (tex.height == wanted.height) &&
+	  (tex.levels == wanted.levels))
+      {
+	 wanted.handle = tex.handle;
+
+	 spare.erase(spare.begin() + i);
+
+	 bytesSpare -= bytes;
+	 bytesInUse += bytes;
+	 ++numReused;
+
+	 return wanted;
+      }
+   }
+
+   glGenTextures(1, &wanted.handle);
+   glBindTexture(GL_TEXTURE_2D, wanted.handle);
+
+   glTexStorage2D(GL_TEXTURE_2D, wanted.levels, format, wanted.width, wanted.height);
+
+   LOG_GL();
+
+   bytesInUse += bytes;
+   peakBytes = std::max(peakBytes, bytesInUse + bytesSpare);
+   ++numCreated;
+
+   return wanted;
+}
+
+void texturePool::release(pooledTexture& tex)
+{
+   if (!tex.handle) { return; }
+
+   size_t bytes = getBytes(tex);
+
+   bytesInUse -= bytes;
+   bytesSpare += bytes;
+
+   spare.push_back(tex);
+
+   while (spare.size() > maxSpareTextures)
+   {
+      glDeleteTextures(1, &spare.front().handle);
+
+      bytesSpare -= getBytes(spare.front());
+      ++numDeleted;
+
+      spare.erase(spare.begin());
+   }
+
+   tex = pooledTexture();
+}
+
+void texturePool::countResize(bool replaced)
+{
+   ++numResizes;
+
+   if (replaced) { ++numReplaced; }
+}
+
+void texturePool::printStats() const
+{
+   const double megabyte = 1024.0 * 1024.0;
+
+   cout << "Textures: " << numResizes << " resizes (" << numReplaced << " needing new textures), "
+	<< numCreated << " created, " << numReused << " reused, " << numDeleted << " deleted; "
+	<< bytesInUse / megabyte << "MB in use, " << bytesSpare / megabyte << "MB spare, "
+	<< peakBytes / megabyte << "MB at most" << endl;
+}
+
+texturePool& getTexturePool()
+{
+   static texturePool pool;
+
+   return pool;
+}
+
+//
+
 framebuffer::framebuffer() : handle (0) {};
 
 framebuffer::~framebuffer() { quit(); }
@@ -342,6 +815,14 @@ framebuffer::~framebuffer() { quit(); }
 bool framebuffer::prep(image& img)
 {
    glGenFramebuffers(1, &handle);
+
+   attach(img);
+
+   return true;
+}
+
+void framebuffer::attach(image& img)
+{
    glBindFramebuffer(GL_FRAMEBUFFER, handle);
 
    glFramebufferTexture2D(GL_FRAMEBUFFER,
@@ -351,8 +832,6 @@ bool framebuffer::prep(image& img)
 			  0);
 
    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
-   return true;
 }
 
 void framebuffer::use()
@@ -361,49 +840,62 @@ void framebuffer::use()
    glBindFramebuffer(GL_READ_FRAMEBUFFER, handle);
 }
 
-void framebuffer::blit(GLint width, GLint height)
+void framebuffer::blit(GLint width, GLint height, GLint dstWidth, GLint dstHeight)
 {
    //This depends on glDrawBuffer() and glReadBuffer() but they aren't
    //variable (even after swapping buffers) so do it once, outside of the function.
    glBlitFramebuffer(0, 0, width, height, //src
-		     0, 0, width, height, //dst
+		     0, 0, dstWidth, dstHeight, //dst
 		     GL_COLOR_BUFFER_BIT,
 		     GL_LINEAR);
 }
 
+void framebuffer::read(GLint width, GLint height, std::vector<uint8_t>& rgba)
+{
+   rgba.resize((size_t) width * (size_t) height * 4);
+
+   glBindFramebuffer(GL_READ_FRAMEBUFFER, handle);
+
+   //Rows are tightly packed, whatever the width
+   glPixelStorei(GL_PACK_ALIGNMENT, 1);
+
+   glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, rgba.data());
+
+   LOG_GL();
+}
+
+void framebuffer::read(GLint width, GLint height, GLuint packBuffer)
+{
+   glBindFramebuffer(GL_READ_FRAMEBUFFER, handle);
+   glBindBuffer(GL_PIXEL_PACK_BUFFER, packBuffer);
+
+   glPixelStorei(GL_PACK_ALIGNMENT, 1);
+
+   //With a pack buffer bound, the pointer's an offset into it
+   glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+
+   glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+   LOG_GL();
+}
+
 void framebuffer::quit()
 {
    glDeleteFramebuffers(1, &handle);
 }
 
-image::image(GLint sizeLocation)
-   : handle (0)
-   , xyLoc (sizeLocation)
+image::image(GLint sizeLocation, GLenum internalFormat)
+   : xyLoc (sizeLocation)
+   , storageFormat (internalFormat)
 { xy[0] = 0; xy[1] = 0; }
 
 image::~image() { quit(); }
 
 void image::prep(GLuint width, GLuint height)
 {
-   glGenTextures(1, &handle);
-   glBindTexture(GL_TEXTURE_2D, handle);
+   texture = getTexturePool().acquire(storageFormat, width, height);
 
-   LOG_GL();
-
-   glTexImage2D(GL_TEXTURE_2D,
-		0, //lod
-		GL_RGBA,
-		width,
-		height,
-		0, //border
-		GL_RGBA,
-		GL_UNSIGNED_BYTE,
-		nullptr);
-
-   //
-
-   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+   setFilter(texture.handle, GL_LINEAR);
 
    LOG_GL();
 
@@ -420,29 +912,31 @@ void image::prep(GLuint width, GLuint height)
 
    LOG_GL();
 
-   //Using nullptr above makes it 'uninitialised'
+   //Storage starts 'uninitialised', and the pool's may be used
    clear();
 }
 
 void image::quit()
 {
-   glDeleteTextures(1, &handle);
+   getTexturePool().release(texture);
 }
 
-void image::use(GLuint binding, GLenum access)
+void image::use(GLuint binding, GLenum access, GLenum format)
 {
    //This 'binds' 'images' to 'texture units'.
    //Formats are ok with different in-shader accesses as long as
    //they're 'compatible'. R32UI (ie a 32bit red) is compatible with
-   //RGBA8UI (ie a 32bit vector) - it's mainly about size.
+   //RGBA8UI (ie a 32bit vector) - it's mainly about size. But the
+   //format here should match the shader's layout qualifier; some
+   //drivers won't load/store/atomic through a mismatch.
 
    glBindImageTexture(binding,
-		      handle,
+		      texture.handle,
 		      0, //level
 		      GL_FALSE, //layered
 		      0, //layer
 		      access,
-		      GL_RGBA8UI); //Could benefit from another param
+		      format);
 }
 
 void image::resize(GLuint width, GLuint height)
@@ -454,31 +948,29 @@ void image::resize(GLuint width, GLuint height)
 
      NB This precludes using imageSize in a shader. There must be
      uniforms with the size, instead. Hence pushSize().
+
+     Growing past what's allocated takes another texture, with room
+     to grow further, and gives this one back to the pool.
    */
 
-   bool needRealloc = (width > xy[0]) || (height > xy[1]);
+   bool replace = (width > texture.width) || (height > texture.height);
 
    xy[0] = width; xy[1] = height;
    
-   if (needRealloc)
+   if (replace)
    {
-      //Must bind for glTexImage2D!
-      glBindTexture(GL_TEXTURE_2D, handle);
+      getTexturePool().release(texture);
+
+      texture = getTexturePool().acquire(storageFormat, width, height, 1, resizeHeadroom);
 
-      glTexImage2D(GL_TEXTURE_2D,
-		   0, //lod
-		   GL_RGBA,
-		   width,
-		   height,
-		   0, //border
-		   GL_RGBA,
-		   GL_UNSIGNED_BYTE,
-		   nullptr);
+      setFilter(texture.handle, GL_LINEAR);
 
       //Clear the newly allocated parts
       clear();
    }
 
+   getTexturePool().countResize(replace);
+
    pushSize();
 }
 
@@ -498,7 +990,7 @@ void image::clear()
    
    static const uint32_t clearValue[4] = {0, 0, 0, 0};
    
-   glClearTexSubImage(handle,
+   glClearTexSubImage(texture.handle,
 		      0, //level
 		      0, 0, 0, //origin x,y,z
 		      xy[0], xy[1], 1, //1: depth
@@ -507,13 +999,29 @@ void image::clear()
 		      clearValue);
 }
 
-void image::blit(framebuffer& fb)
+void image::blit(framebuffer& fb, GLint width, GLint height)
 {
    GLint wid, hei;
 
    wid = (GLint) xy[0]; hei = (GLint) xy[1];
 
-   fb.blit(wid, hei);
+   fb.blit(wid, hei, width, height);
+}
+
+void image::read(framebuffer& fb, std::vector<uint8_t>& rgba)
+{
+   //Only the part in use, which may be smaller than what's allocated
+   fb.read((GLint) xy[0], (GLint) xy[1], rgba);
+}
+
+void image::read(framebuffer& fb, GLuint packBuffer)
+{
+   fb.read((GLint) xy[0], (GLint) xy[1], packBuffer);
+}
+
+void image::getSize(GLuint& width, GLuint& height) const
+{
+   width = xy[0]; height = xy[1];
 }
 
 float image::getAspectRatio() const
@@ -521,6 +1029,180 @@ float image::getAspectRatio() const
    return (float) xy[0] / (float) xy[1];
 }
 
+pyramid::pyramid(GLuint levels)
+   : maxLevels (levels)
+   , numLevels (0)
+{
+   xy[0] = 0; xy[1] = 0;
+}
+
+pyramid::~pyramid() { quit(); }
+
+void pyramid::prep(GLuint width, GLuint height)
+{
+   if (!maxLevels) { return; }
+
+   xy[0] = width; xy[1] = height;
+
+   GLuint baseX, baseY;
+   fitLevels(baseX, baseY);
+
+   alloc(baseX, baseY, 0.f);
+}
+
+void pyramid::quit()
+{
+   getTexturePool().release(texture);
+}
+
+void pyramid::alloc(GLuint baseX, GLuint baseY, float headroom)
+{
+   texture = getTexturePool().acquire(GL_R32UI, baseX, baseY, numLevels, headroom);
+
+   glBindTexture(GL_TEXTURE_2D, texture.handle);
+
+   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, texture.levels - 1);
+
+   setFilter(texture.handle, GL_NEAREST);
+
+   LOG_GL();
+}
+
+void pyramid::fitLevels(GLuint& baseX, GLuint& baseY)
+{
+   numLevels = 0;
+
+   //Stop once a level is a single texel, or there are enough
+   for (GLuint level = 0; level < maxLevels; ++level)
+   {
+      ++numLevels;
+
+      GLuint levelX, levelY;
+      getLevelSize(level, levelX, levelY);
+
+      if ((levelX == 1) && (levelY == 1)) { break; }
+   }
+
+   /*
+     For the texture to be complete (and so usable for image
+     loads/stores at all) each level must be exactly half the last,
+     rounding down. But the sizes in use round up, so that every texel
+     has a parent. So allocate level 0 big enough that halving it
+     never falls short of a level's size in use.
+   */
+   baseX = 1; baseY = 1;
+
+   for (GLuint level = 0; level < numLevels; ++level)
+   {
+      GLuint levelX, levelY;
+      getLevelSize(level, levelX, levelY);
+
+      baseX = max(baseX, levelX << level);
+      baseY = max(baseY, levelY << level);
+   }
+}
+
+void pyramid::use(GLuint level, GLuint binding, GLenum access)
+{
+   glBindImageTexture(binding,
+		      texture.handle,
+		      level,
+		      GL_FALSE, //layered
+		      0, //layer
+		      access,
+		      GL_R32UI);
+}
+
+void pyramid::resize(GLuint width, GLuint height)
+{
+   if (!maxLevels) { return; }
+
+   xy[0] = width; xy[1] = height;
+
+   GLuint baseX, baseY;
+   fitLevels(baseX, baseY);
+
+   //Same approach as image::resize(): only replace to grow. A bigger
+   //level 0 than needed still halves to big enough levels.
+   bool replace = (baseX > texture.width) || (baseY > texture.height) ||
+      (numLevels > texture.levels);
+
+   if (replace)
+   {
+      getTexturePool().release(texture);
+
+      alloc(baseX, baseY, resizeHeadroom);
+   }
+}
+
+void pyramid::bindTexture(GLuint unit)
+{
+   glActiveTexture(GL_TEXTURE0 + unit);
+   glBindTexture(GL_TEXTURE_2D, texture.handle);
+   glActiveTexture(GL_TEXTURE0);
+}
+
+void pyramid::reduce(image& base, const int localSizes[3])
+{
+   //Bindings and locations; see header
+   const GLuint sourceBinding = 3;
+   const GLuint targetBinding = 4;
+
+   const GLint sourceXYLoc = 6;
+   const GLint targetXYLoc = 7;
+
+   GLuint baseX, baseY;
+   base.getSize(baseX, baseY);
+
+   for (GLuint level = 0; level < numLevels; ++level)
+   {
+      GLuint sourceX = baseX, sourceY = baseY;
+
+      if (level)
+      {
+	 getLevelSize(level - 1, sourceX, sourceY);
+
+	 use(level - 1, sourceBinding, GL_READ_ONLY);
+      }
+
+      else { base.use(sourceBinding, GL_READ_ONLY, GL_R32UI); }
+
+      GLuint targetX, targetY;
+      getLevelSize(level, targetX, targetY);
+
+      use(level, targetBinding, GL_WRITE_ONLY);
+
+      glUniform2ui(sourceXYLoc, sourceX, sourceY);
+      glUniform2ui(targetXYLoc, targetX, targetY);
+
+      uint32_t xWkgps, yWkgps;
+
+      getWkgpDimensions(xWkgps, yWkgps,
+			localSizes[0], localSizes[1],
+			targetX, targetY);
+
+      glDispatchCompute(xWkgps, yWkgps, 1);
+
+      //Each level depends on the one before
+      glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+   }
+
+   LOG_GL();
+}
+
+void pyramid::getLevelSize(GLuint level, GLuint& width, GLuint& height) const
+{
+   //Round up, so every texel in the level below has a parent
+   GLuint divisor = 2u << level;
+
+   width = (xy[0] + divisor - 1) / divisor;
+   height = (xy[1] + divisor - 1) / divisor;
+
+   width = width ? width : 1;
+   height = height ? height : 1;
+}
+
 buffer::buffer() : handle (0) , nBytes (0) {}
 buffer::~buffer() { quit(); }
 
@@ -546,6 +1228,57 @@ void buffer::prep(vector<float> data, GLuint binding)
    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, handle);
 }
 
+void buffer::prep(size_t bytes, GLuint binding)
+{
+   nBytes = bytes;
+
+   glGenBuffers(1, &handle);
+
+   glBindBuffer(GL_SHADER_STORAGE_BUFFER, handle);
+
+   glBufferData(GL_SHADER_STORAGE_BUFFER,
+		bytes,
+		nullptr,
+		GL_DYNAMIC_COPY); //Written and read by the GPU only
+
+   glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, handle);
+}
+
+void buffer::prep(const void* data, size_t bytes, GLuint binding)
+{
+   nBytes = bytes;
+
+   glGenBuffers(1, &handle);
+
+   glBindBuffer(GL_SHADER_STORAGE_BUFFER, handle);
+
+   glBufferData(GL_SHADER_STORAGE_BUFFER, bytes, data, GL_STATIC_DRAW);
+
+   glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, handle);
+}
+
+void* buffer::prepMapped(size_t bytes, GLuint binding)
+{
+   nBytes = bytes;
+
+   glGenBuffers(1, &handle);
+
+   glBindBuffer(GL_SHADER_STORAGE_BUFFER, handle);
+
+   //Coherent, so writes need no flushing to be seen by later commands
+   const GLbitfield access = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+   glBufferStorage(GL_SHADER_STORAGE_BUFFER, bytes, nullptr, access);
+
+   void* mapped = glMapBufferRange(GL_SHADER_STORAGE_BUFFER, 0, bytes, access);
+
+   if (!mapped) { cerr << "Couldn't map a buffer of " << bytes << " bytes" << endl; }
+
+   glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, handle);
+
+   return mapped;
+}
+
 void buffer::quit()
 {
    glDeleteBuffers(1, &handle);
@@ -553,25 +1286,114 @@ void buffer::quit()
 
 void buffer::clear()
 {
-   //Value given depends on current pipeline (of depth being in x etc,
-   //and on the format of the buffer being a bunch of (32b) uvec4s)
+   clear(0, nBytes);
+}
 
+void buffer::clear(size_t offset, size_t bytes)
+{
    //0 will mean both the furthest depth possible, and a colour value
-   //of (0, 0, 0) i.e. black
+   //of (0, 0, 0) i.e. black. (Offset and size must be multiples of
+   //4, the size of the format.)
 
    GLuint value = 0;
    
    glBindBuffer(GL_SHADER_STORAGE_BUFFER, handle);
-   glClearBufferData(handle,
-		     GL_RGBA32UI, //dst format
-		     GL_RGBA, //src swizzle
-		     GL_UNSIGNED_INT, //src type
-		     &value);
+   glClearBufferSubData(GL_SHADER_STORAGE_BUFFER,
+			GL_R32UI, //dst format
+			offset,
+			bytes,
+			GL_RED_INTEGER, //src swizzle
+			GL_UNSIGNED_INT, //src type
+			&value);
 
    //TODO check (at least in debug)
 }
 
-void surfelModel::prep(const string fileName, GLuint binding)
+void buffer::write(const void* data, size_t offset, size_t bytes)
+{
+   glBindBuffer(GL_SHADER_STORAGE_BUFFER, handle);
+   glBufferSubData(GL_SHADER_STORAGE_BUFFER, offset, bytes, data);
+}
+
+void buffer::bind(GLuint binding)
+{
+   glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, handle);
+}
+
+/*
+  Sort surfels (as groups of 4 floats) along a Morton curve through
+  their bounding box, so that surfels near each other in the buffer
+  are near each other in space.
+*/
+static void sortSpatially(vector<float>& surfels)
+{
+   size_t numSurfels = surfels.size() / 4;
+
+   if (!numSurfels) { return; }
+
+   float low[3], high[3];
+
+   for (int axis = 0; axis < 3; ++axis)
+   {
+      low[axis] = high[axis] = surfels[axis];
+   }
+
+   for (size_t i = 0; i < numSurfels; ++i)
+   {
+      for (int axis = 0; axis < 3; ++axis)
+      {
+	 low[axis] = min(low[axis], surfels[i * 4 + axis]);
+	 high[axis] = max(high[axis], surfels[i * 4 + axis]);
+      }
+   }
+
+   //Spread the bottom 10 bits of x out to every third bit
+   auto spread = [](uint32_t x)
+   {
+      x = (x | (x << 16)) & 0x030000FF;
+      x = (x | (x << 8)) & 0x0300F00F;
+      x = (x | (x << 4)) & 0x030C30C3;
+      x = (x | (x << 2)) & 0x09249249;
+
+      return x;
+   };
+
+   vector<pair<uint32_t, uint32_t>> keys; //code, index
+   keys.reserve(numSurfels);
+
+   for (size_t i = 0; i < numSurfels; ++i)
+   {
+      uint32_t code = 0;
+
+      for (int axis = 0; axis < 3; ++axis)
+      {
+	 float extent = high[axis] - low[axis];
+
+	 float t = (extent > 0.f) ? (surfels[i * 4 + axis] - low[axis]) / extent : 0.f;
+
+	 code |= spread((uint32_t) (t * 1023.f)) << axis;
+      }
+
+      keys.push_back(make_pair(code, (uint32_t) i));
+   }
+
+   sort(keys.begin(), keys.end());
+
+   vector<float> sorted;
+   sorted.reserve(surfels.size());
+
+   for (auto& key : keys)
+   {
+      sorted.insert(sorted.end(),
+		    surfels.begin() + key.second * 4,
+		    surfels.begin() + key.second * 4 + 4);
+   }
+
+   surfels.swap(sorted);
+}
+
+void surfelModel::prep(const string fileName, GLuint binding,
+		       GLuint clusterSize, float defaultRadius)
 {
    if (!fileName.size()) { throw invalid_argument("No file name given for surfel model"); }
 
@@ -583,6 +1405,39 @@ void surfelModel::prep(const string fileName, GLuint binding)
 
    if (load.size() % 4) { throw invalid_argument("Surfel input data not divisible into groups of 4 floats"); }
 
+   clusterBounds.clear();
+
+   if (clusterSize)
+   {
+      sortSpatially(load);
+
+      size_t numSurfels = load.size() / 4;
+
+      for (size_t first = 0; first < numSurfels; first += clusterSize)
+      {
+	 size_t last = min(first + clusterSize, numSurfels);
+
+	 float low[3], high[3];
+
+	 for (size_t i = first; i < last; ++i)
+	 {
+	    float radius = load[i * 4 + 3] > 0.f ? load[i * 4 + 3] : defaultRadius;
+
+	    for (int axis = 0; axis < 3; ++axis)
+	    {
+	       float lowHere = load[i * 4 + axis] - radius;
+	       float highHere = load[i * 4 + axis] + radius;
+
+	       low[axis] = (i == first) ? lowHere : min(low[axis], lowHere);
+	       high[axis] = (i == first) ? highHere : max(high[axis], highHere);
+	    }
+	 }
+
+	 clusterBounds.insert(clusterBounds.end(), { low[0], low[1], low[2], 0.f,
+						    high[0], high[1], high[2], 0.f });
+      }
+   }
+
    data.prep(load, binding);
 }
 
@@ -592,6 +1447,46 @@ size_t surfelModel::getNumSurfels() const
    return (data.size() / sizeof(float)) / 4;
 }
 
+string deviceCapabilities::getDriverKey() const
+{
+   return vendor + "|" + renderer + "|" + version;
+}
+
+const deviceCapabilities& getDeviceCapabilities()
+{
+   static deviceCapabilities caps;
+   static bool queried = false;
+
+   if (queried) { return caps; }
+
+   /*
+     The minimums expected are 65535 workgroups along each dimension,
+     local sizes of 1024/1024/64 and 1024 invocations in total; but
+     there's no need to assume.
+   */
+   for (GLuint i = 0; i < 3; ++i)
+   {
+      glGetIntegeri_v(GL_MAX_COMPUTE_WORK_GROUP_COUNT, i, &caps.maxWkgpCount[i]);
+      glGetIntegeri_v(GL_MAX_COMPUTE_WORK_GROUP_SIZE, i, &caps.maxWkgpSize[i]);
+   }
+
+   glGetIntegerv(GL_MAX_COMPUTE_WORK_GROUP_INVOCATIONS, &caps.maxWkgpInvocations);
+
+   glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &caps.numProgramBinaryFormats);
+
+   glGetIntegerv(GL_MAX_TEXTURE_SIZE, &caps.maxTextureSize);
+
+   caps.vendor = (const char*) glGetString(GL_VENDOR);
+   caps.renderer = (const char*) glGetString(GL_RENDERER);
+   caps.version = (const char*) glGetString(GL_VERSION);
+
+   LOG_GL();
+
+   queried = true;
+
+   return caps;
+}
+
 bool getWkgpDimensions(uint32_t& xWkgps, uint32_t& yWkgps,
 		       uint32_t localX, uint32_t localY,
 		       uint32_t reqGlobalX, uint32_t reqGlobalY)
@@ -633,17 +1528,10 @@ bool getWkgpDimensions(uint32_t& xWkgps, uint32_t& yWkgps,
 
    //These aren't the max globals (ie # invocations). They're max
    //-numbers- of workgroups.
-   //These would be better done once and saved, etc.
-   
-   GLint maxXWkgps, maxYWkgps;
-
-   glGetIntegeri_v(GL_MAX_COMPUTE_WORK_GROUP_COUNT,
-		   0,
-		   &maxXWkgps);
+   const deviceCapabilities& caps = getDeviceCapabilities();
 
-   glGetIntegeri_v(GL_MAX_COMPUTE_WORK_GROUP_COUNT,
-		   1,
-		   &maxYWkgps);
+   GLint maxXWkgps = caps.maxWkgpCount[0];
+   GLint maxYWkgps = caps.maxWkgpCount[1];
 
    //Add 1 if it doesn't cleanly divide. (1 because division rounds down)
    xWkgps = reqGlobalX / localX + ((reqGlobalX % localX)? 1 : 0);
@@ -657,15 +1545,48 @@ bool getWkgpDimensions(uint32_t& xWkgps, uint32_t& yWkgps,
    else { return true; }
 }
 
-void surfelModel::render(int localX, int localY)
+void waitForFence(GLsync fence, double& waitedSeconds)
 {
-   uint32_t xWkgps, yWkgps;
+   //glClientWaitSync() times out in nanoseconds; wait this long per try
+   const GLuint64 waitTimeout = 100000000;
+
+   auto start = chrono::steady_clock::now();
+
+   //Flushing, the first time; once's enough
+   GLenum result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, waitTimeout);
+
+   while (result == GL_TIMEOUT_EXPIRED)
+   {
+      result = glClientWaitSync(fence, 0, waitTimeout);
+   }
+
+   waitedSeconds += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+   LOG_GL();
+}
+
+bool dispatchPlan::plan(uint32_t localX, uint32_t localY,
+			uint32_t globalX, uint32_t globalY)
+{
+   return getWkgpDimensions(xWkgps, yWkgps, localX, localY, globalX, globalY);
+}
+
+void dispatchPlan::dispatch() const
+{
+   glDispatchCompute(xWkgps, yWkgps, 1);
+}
+
+void surfelModel::planRender(int localX, int localY, int perInvocation)
+{
+   //Round up, as with the workgroups
+   uint32_t numInvocations = (uint32_t) ((getNumSurfels() + perInvocation - 1) /
+					 perInvocation);
       
-   getWkgpDimensions(xWkgps, yWkgps,
-		     (uint32_t) localX, (uint32_t) localY,
-		     getNumSurfels(), 1);
+   renderPlan.plan((uint32_t) localX, (uint32_t) localY,
+		   numInvocations, 1);
+}
 
-   glDispatchCompute(xWkgps,
-		     yWkgps,
-		     1);
+void surfelModel::render()
+{
+   renderPlan.dispatch();
 }
@@ -9,38 +9,148 @@
 #define GEOM_CPP
 #include "../lib/geom/geom.h"
 
-//This is so a single error can be inputted for places in a loop.
-//Still won't work with multiple files yet (since a function in
-//another file could be called in 2 places in the same loop and should
-//perhaps be logged twice? TODO) so I've left in printErrorGL().
-extern std::map<int, std::string> errorsGL;
+/*
+  GL error checking, at the sites marked with LOG_GL().
+
+  Built with GL_CHECKS (see the Makefile's debug target), errors come
+  from a KHR_debug message callback, once prepDebugOutputGL() has set
+  it up. The callback holds on to messages til the next LOG_GL(),
+  which files them under its site, so a site costs a function call
+  rather than a glGetError() (and whatever driver synchronisation that
+  brings). Without debug output, LOG_GL() falls back on glGetError().
+
+  Without GL_CHECKS, as in release builds, LOG_GL() and errorGL()
+  compile to nothing.
+
+  Only the first errors at each site (file and line) are kept, so ones
+  in a loop are logged once; printErrorsGL() prints them.
+*/
+extern std::map<std::string, std::string> errorsGL;
 
 std::string getErrorGL();
 void printErrorGL(const char* file, int line);
-void logErrorGL(int line);
+void logErrorGL(const char* file, int line);
 void printErrorsGL();
 
+//Errors since the last site that are expected, and not to be logged
+void discardErrorsGL();
+
+//Once there's a context. False if there's no debug output to be had.
+bool prepDebugOutputGL();
+
+#ifdef GL_CHECKS
+#define errorGL() printErrorGL(__FILE__, __LINE__)
+#define LOG_GL() logErrorGL(__FILE__, __LINE__)
+#else
+#define errorGL()
+#define LOG_GL()
+#endif
+
+//What the GL can do, queried once (see getDeviceCapabilities())
+struct deviceCapabilities
+{
+   //Numbers of workgroups, along x, y and z
+   GLint maxWkgpCount[3];
+   //Local sizes, along x, y and z, and in total
+   GLint maxWkgpSize[3];
+   GLint maxWkgpInvocations;
+
+   GLint numProgramBinaryFormats;
+
+   //Width or height, of a 2D texture
+   GLint maxTextureSize;
+
+   std::string vendor;
+   std::string renderer;
+   std::string version;
+
+   //Vendor, renderer and version together, for keying caches of
+   //things only good for this GPU and driver
+   std::string getDriverKey() const;
+};
+
+//Queried the first time it's called, so there has to be a context
+//by then.
+const deviceCapabilities& getDeviceCapabilities();
+
 bool getWkgpDimensions(uint32_t& xWkgps, uint32_t& yWkgps,
 		       uint32_t localX, uint32_t localY,
 		       uint32_t reqGlobalX, uint32_t reqGlobalY);
 
+//However long it takes, adding that to waitedSeconds. Flushes, so the
+//fence is sure to get to the GPU. The fence is left for the caller.
+void waitForFence(GLsync fence, double& waitedSeconds);
+
+/*
+  The workgroup counts for a dispatch, worked out ahead of time so the
+  frame loop needn't. plan() has to be done again whenever the size of
+  what's dispatched over changes.
+*/
+struct dispatchPlan
+{
+   uint32_t xWkgps;
+   uint32_t yWkgps;
+
+   dispatchPlan() : xWkgps (0) , yWkgps (0) {}
+
+   //As getWkgpDimensions()
+   bool plan(uint32_t localX, uint32_t localY,
+	     uint32_t globalX, uint32_t globalY);
+
+   //With the program in use
+   void dispatch() const;
+};
+
+//Macros to #define in a shader's source (after its #version), so one
+//file can be compiled into variants: name -> value
+typedef std::map<std::string, std::string> shaderDefines;
+
+//Where program binaries are cached (see program::prep()); empty to
+//always compile from source.
+extern std::string programCacheDir;
+
+//Startup time spent making programs, for printProgramCacheStats()
+struct programCacheStats
+{
+   unsigned int numLoaded;
+   unsigned int numCompiled;
+
+   double loadMs;
+   double compileMs;
+
+   //How long the loaded programs took to compile when they were
+   //cached, less how long they took to load
+   double savedMs;
+};
+
+extern programCacheStats programCacheTotals;
+
+void printProgramCacheStats();
+
 class shader
 {
 private:
    std::string filename;
+   shaderDefines defines;
 
    GLenum kind;
    GLuint handle;
 
-   std::string read();
-
    std::string getLogGL();
 public:
-   shader(const std::string& nm);
+   shader(const std::string& nm,
+	  const shaderDefines& defs = shaderDefines(),
+	  GLenum shaderKind = GL_COMPUTE_SHADER);
    ~shader();
    
    bool prep(GLuint program);
    void quit();
+
+   //The source as compiled: the file, with the defines put in
+   std::string read();
+
+   //Takes effect at the next prep()
+   void setDefines(const shaderDefines& defs) { defines = defs; }
 };
 
 class program
@@ -48,28 +158,117 @@ class program
 private:
    GLuint handle;
 
-   shader compute;
+   //The compute shader; or, drawing, the fragment shader, which goes
+   //with vertexShader
+   shader mainShader;
+   shader vertexShader;
+   bool drawing;
 
    std::string getLogGL();
 
+   //A binary from the cache, if there's one for this source and
+   //driver. compileMs is how long it originally took to compile.
+   bool loadBinary(const std::string& path, const std::string& driverKey,
+		   uint64_t sourceHash, double& compileMs);
+   void saveBinary(const std::string& path, const std::string& driverKey,
+		   uint64_t sourceHash, double compileMs);
+
 public:
-   program(const std::string& shaderNm);
+   program(const std::string& shaderNm,
+	   const shaderDefines& defs = shaderDefines());
+   //For drawing, rather than dispatching: shaderNm is then the
+   //fragment shader. The defines are the same for both. An empty
+   //vertexShaderNm makes a compute program, as above.
+   program(const std::string& shaderNm, const shaderDefines& defs,
+	   const std::string& vertexShaderNm);
    ~program();
    
    bool prep();
    void quit();
 
+   //Recompile as a different variant. Its uniforms have to be pushed
+   //again, to the new handle.
+   bool rebuild(const shaderDefines& defs);
+
    void use();
 
    GLuint getHandle();
 };
 
+//A texture with immutable storage (glTexStorage2D), from a texturePool
+struct pooledTexture
+{
+   GLuint handle;
+   GLenum format;
+
+   //As allocated, which may be more than's asked for
+   GLuint width, height;
+   GLuint levels;
+
+   pooledTexture() : handle (0) , format (GL_NONE) , width (0) , height (0) , levels (0) {}
+};
+
+class texturePool
+/*
+  Immutable textures, in size buckets, for images that grow and
+  shrink with the window. Storage can't be resized once allocated, so
+  growing means another texture; asking for sizes rounded up to a
+  bucket (powers of two, and one and a half times them) makes that
+  rare. A texture given back is kept to be handed out again, for the
+  next time the window's that size, rather than allocating (and
+  fragmenting VRAM) on every resize.
+
+  Only a few are kept for reuse; past that the oldest go.
+*/
+{
+private:
+   //Given back, oldest first
+   std::vector<pooledTexture> spare;
+
+   size_t numResizes;
+   size_t numReplaced;
+
+   size_t numCreated;
+   size_t numReused;
+   size_t numDeleted;
+
+   size_t bytesInUse;
+   size_t bytesSpare;
+   size_t peakBytes;
+
+   static size_t getBytes(const pooledTexture& tex);
+
+public:
+   texturePool();
+
+   /*
+     At least width x height at level 0, with levels levels (each half
+     the last) - more, to make room to grow by headroom (e.g. 0.25 for
+     a quarter) before having to be replaced.
+   */
+   pooledTexture acquire(GLenum format, GLuint width, GLuint height,
+			 GLuint levels = 1, float headroom = 0.f);
+   void release(pooledTexture& tex);
+
+   //For printStats(): an image resized, and whether that took
+   //another texture
+   void countResize(bool replaced);
+
+   void printStats() const;
+
+   size_t getBytesInUse() const { return bytesInUse; }
+};
+
+//The one the images use. Textures still in it when the program ends
+//go with the context.
+texturePool& getTexturePool();
+
 class framebuffer;
 
 class image
 {
 private:
-   GLuint handle;
+   pooledTexture texture;
 
    /*
      These are stored so you can sub-buffer (both in e.g. clear(),
@@ -80,25 +279,85 @@ private:
    GLuint xy[2];
    GLint xyLoc;
 
-   //Upload x, y as uniforms
-   void pushSize();
+   //Sized, as it must be to be bound as an image
+   GLenum storageFormat;
 
 public:
-   image(GLint sizeLocation);
+   image(GLint sizeLocation, GLenum internalFormat = GL_RGBA8);
    ~image();
    
    void prep(GLuint width, GLuint height);
    void quit();
 
-   void use(GLuint binding, GLenum access);
+   void use(GLuint binding, GLenum access, GLenum format = GL_RGBA8UI);
+   //Growing may take another texture, which then has to be bound
+   //(with use(), or to a framebuffer) again.
    void resize(GLuint width, GLuint height);
    void clear();
-   void blit(framebuffer& fb);
+   //Stretched (filtered linearly) over width x height
+   void blit(framebuffer& fb, GLint width, GLint height);
+   //As RGBA, bottom row first, through fb (which must have this image)
+   void read(framebuffer& fb, std::vector<uint8_t>& rgba);
+   //Likewise, into packBuffer (see framebuffer::read())
+   void read(framebuffer& fb, GLuint packBuffer);
+
+   //Upload x, y as uniforms (to the program in use). prep() and
+   //resize() do this themselves; it's for other programs.
+   void pushSize();
 
-   GLuint getHandle() { return handle; }
+   GLuint getHandle() { return texture.handle; }
+   void getSize(GLuint& width, GLuint& height) const;
    float getAspectRatio() const;
 };
 
+class pyramid
+/*
+  A chain of mip levels, each half the size of the last, for reducing
+  an image. Level 0 of the pyramid is already half the size of the
+  image it's made from; that image stands in for the full-size level.
+  Texels are single 32bit uints, like those in the samples image.
+*/
+{
+private:
+   pooledTexture texture;
+
+   GLuint maxLevels;
+   GLuint numLevels;
+
+   //Size of the image the pyramid is made from. As in image, this is
+   //the size in use, which may be smaller than what's allocated.
+   GLuint xy[2];
+
+   //Levels needed for xy, and how big level 0 must be for them
+   void fitLevels(GLuint& baseX, GLuint& baseY);
+   //numLevels of them, from the pool
+   void alloc(GLuint baseX, GLuint baseY, float headroom);
+
+public:
+   pyramid(GLuint levels);
+   ~pyramid();
+
+   void prep(GLuint width, GLuint height);
+   void quit();
+
+   void use(GLuint level, GLuint binding, GLenum access);
+   void resize(GLuint width, GLuint height);
+
+   //Bind every level at once, for texelFetch()ing from any of them
+   void bindTexture(GLuint unit);
+
+   /*
+     Fill every level from the image below it, with the program in use
+     (which decides how texels are combined). The program gets the
+     source level at image binding 3, the target at binding 4, and
+     their sizes in uniforms at locations 6 and 7.
+   */
+   void reduce(image& base, const int localSizes[3]);
+
+   GLuint getNumLevels() const { return numLevels; }
+   void getLevelSize(GLuint level, GLuint& width, GLuint& height) const;
+};
+
 class framebuffer
 {
 private:
@@ -111,8 +370,17 @@ public:
    bool prep(image& img);
    void quit();
 
+   //Again, after img has taken another texture (see image::resize()).
+   //Leaves no framebuffer bound.
+   void attach(image& img);
+
    void use();
-   void blit(GLint width, GLint height);
+   //width x height of it, to dstWidth x dstHeight of the window
+   void blit(GLint width, GLint height, GLint dstWidth, GLint dstHeight);
+   void read(GLint width, GLint height, std::vector<uint8_t>& rgba);
+   //Into packBuffer (a pixel buffer object, big enough) rather than
+   //memory, so it needn't be waited for til the buffer's mapped
+   void read(GLint width, GLint height, GLuint packBuffer);
 };
 
 class buffer
@@ -128,10 +396,30 @@ public:
    ~buffer();
    
    void prep(std::vector<float> data, GLuint binding);
+   //Uninitialised, for the GPU to fill
+   void prep(size_t bytes, GLuint binding);
+   //Of any layout (e.g. structs to match a std430 block)
+   void prep(const void* data, size_t bytes, GLuint binding);
+   /*
+     Immutable storage, mapped for writing for as long as the buffer
+     lives (persistent and coherent), so the CPU writes straight into
+     it while the GPU reads. Null, having said so, if it can't be
+     mapped. Nothing stops the CPU overwriting what the GPU's yet to
+     read; that's for the caller to fence.
+   */
+   void* prepMapped(size_t bytes, GLuint binding);
    void quit();
 
    void clear();
+   void clear(size_t offset, size_t bytes);
+
+   //Replace part of it (with the GL's usual ordering against what's
+   //already been submitted)
+   void write(const void* data, size_t offset, size_t bytes);
 
+   void bind(GLuint binding);
+
+   GLuint getHandle() const { return handle; }
    size_t size() const { return nBytes; }
 };
 
@@ -140,10 +428,29 @@ class surfelModel
 private:
    buffer data;
 
-   size_t getNumSurfels() const;
+   //Bounding boxes of each run of clusterSize surfels, as min xyz
+   //(and 0) then max xyz (and 0). Empty unless asked for in prep().
+   std::vector<float> clusterBounds;
+
+   dispatchPlan renderPlan;
 
 public:
-   void prep(const std::string fileName, GLuint binding);
+   /*
+     With a clusterSize, the surfels are sorted so that each run of
+     clusterSize of them is close together in space, and the runs'
+     bounds are kept (see getClusterBounds()). Bounds include each
+     surfel's radius, or defaultRadius if it has none.
+   */
+   void prep(const std::string fileName, GLuint binding,
+	     GLuint clusterSize = 0, float defaultRadius = 0.f);
    
-   void render(int localX, int localY);
+   //For render(), with surfelsToSamples' local sizes. Each invocation
+   //draws perInvocation surfels. Needs doing again after prep().
+   void planRender(int localX, int localY, int perInvocation = 1);
+
+   void render();
+
+   size_t getNumSurfels() const;
+
+   const std::vector<float>& getClusterBounds() const { return clusterBounds; }
 };
@@ -0,0 +1,162 @@
+#include "../lib/glad/include/glad/glad.h"
+
+#include "egl_utils.hpp"
+
+#include <EGL/eglext.h>
+
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+using namespace std;
+
+namespace
+{
+   bool hasExtension(const char* extensions, const char* name)
+   {
+      if (!extensions) { return false; }
+
+      size_t length = strlen(name);
+
+      //Space-separated; check it's not just the start of a longer name
+      for (const char* found = strstr(extensions, name);
+	   found;
+	   found = strstr(found + length, name))
+      {
+	 if ((found == extensions || found[-1] == ' ') &&
+	     (found[length] == ' ' || found[length] == '\0'))
+	 {
+	    return true;
+	 }
+      }
+
+      return false;
+   }
+
+   EGLDisplay getDisplay()
+   {
+      const char* clientExtensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+
+      if (hasExtension(clientExtensions, "EGL_MESA_platform_surfaceless"))
+      {
+	 PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+	    (PFNEGLGETPLATFORMDISPLAYEXTPROC) eglGetProcAddress("eglGetPlatformDisplayEXT");
+
+	 if (getPlatformDisplay)
+	 {
+	    EGLDisplay display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA,
+						    EGL_DEFAULT_DISPLAY,
+						    nullptr);
+
+	    if (display != EGL_NO_DISPLAY) { return display; }
+	 }
+      }
+
+      return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+   }
+}
+
+eglInstance::eglInstance()
+   : display (EGL_NO_DISPLAY)
+   , context (EGL_NO_CONTEXT)
+   , surface (EGL_NO_SURFACE)
+{ prep(); }
+
+eglInstance::~eglInstance() { quit(); }
+
+void
+eglInstance::prep()
+{
+   display = getDisplay();
+
+   EGLint major, minor;
+
+   if ((display == EGL_NO_DISPLAY) || !eglInitialize(display, &major, &minor))
+   {
+      throw runtime_error("EGL failed to initialise");
+   }
+
+   if (!eglBindAPI(EGL_OPENGL_API))
+   {
+      throw runtime_error("EGL has no desktop OpenGL");
+   }
+
+   const char* extensions = eglQueryString(display, EGL_EXTENSIONS);
+
+   bool surfaceless = hasExtension(extensions, "EGL_KHR_surfaceless_context");
+
+   //Only a pbuffer needs particular surface types
+   const EGLint configAttribs[] =
+      {
+	 EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+	 EGL_SURFACE_TYPE, surfaceless ? 0 : EGL_PBUFFER_BIT,
+	 EGL_NONE
+      };
+
+   EGLConfig config;
+   EGLint numConfigs = 0;
+
+   if (!eglChooseConfig(display, configAttribs, &config, 1, &numConfigs) || !numConfigs)
+   {
+      throw runtime_error("EGL has no suitable config");
+   }
+
+   //4.4 for glClearTex(Sub)Image, as with SDL
+   const EGLint contextAttribs[] =
+      {
+	 EGL_CONTEXT_MAJOR_VERSION_KHR, 4,
+	 EGL_CONTEXT_MINOR_VERSION_KHR, 4,
+	 EGL_CONTEXT_OPENGL_PROFILE_MASK_KHR, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT_KHR,
+#ifdef GL_CHECKS
+	 //Drivers may only give full debug output in a debug context
+	 EGL_CONTEXT_FLAGS_KHR, EGL_CONTEXT_OPENGL_DEBUG_BIT_KHR,
+#endif
+	 EGL_NONE
+      };
+
+   context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttribs);
+
+   if (context == EGL_NO_CONTEXT)
+   {
+      throw runtime_error("EGL failed to create an OpenGL 4.4 core context");
+   }
+
+   if (!surfaceless)
+   {
+      //Never drawn to; it just has to be there to make the context
+      //current.
+      const EGLint pbufferAttribs[] = {EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE};
+
+      surface = eglCreatePbufferSurface(display, config, pbufferAttribs);
+
+      if (surface == EGL_NO_SURFACE)
+      {
+	 throw runtime_error("EGL failed to create a pbuffer");
+      }
+   }
+
+   if (!eglMakeCurrent(display, surface, surface, context))
+   {
+      throw runtime_error("EGL failed to make the context current");
+   }
+
+   //Core functions too; Mesa and the proprietary drivers all give
+   //those through eglGetProcAddress().
+   if (!gladLoadGLLoader((GLADloadproc) eglGetProcAddress))
+   {
+      throw runtime_error("Glad failed to load some OpenGL function");
+   }
+}
+
+void
+eglInstance::quit()
+{
+   if (display == EGL_NO_DISPLAY) { return; }
+
+   eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+
+   if (surface != EGL_NO_SURFACE) { eglDestroySurface(display, surface); }
+   if (context != EGL_NO_CONTEXT) { eglDestroyContext(display, context); }
+
+   eglTerminate(display);
+}
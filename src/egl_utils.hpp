@@ -0,0 +1,34 @@
+#pragma once
+
+#include <EGL/egl.h>
+
+class eglInstance
+/*
+  A GL context with no window, for running the renderer where there's
+  no display (e.g. render farm nodes, CI). Prefers Mesa's surfaceless
+  platform, where there's no need for any surface at all; otherwise
+  it makes do with the default display and a small pbuffer. Frames are
+  drawn into the renderer's own images either way.
+
+  Like sdlInstance, it loads the GL's functions (with Glad) once the
+  context is current.
+*/
+{
+private:
+   EGLDisplay display;
+   EGLContext context;
+   //EGL_NO_SURFACE where the context can do without
+   EGLSurface surface;
+
+   //Throws runtime_error, with what failed
+   void prep();
+   void quit();
+
+public:
+   eglInstance();
+   ~eglInstance();
+
+   //Not copyable; it owns the context
+   eglInstance(const eglInstance&) = delete;
+   eglInstance& operator=(const eglInstance&) = delete;
+};
@@ -0,0 +1,144 @@
+#include "../lib/glad/include/glad/glad.h"
+
+#include "framePacer.hpp"
+
+using namespace std;
+
+static double getMs(chrono::steady_clock::duration span)
+{
+   return chrono::duration<double, milli>(span).count();
+}
+
+framePacer::framePacer(GLuint framesInFlight)
+   : frames (framesInFlight ? framesInFlight : 1)
+   , next (0)
+   , periodStart (clock::now())
+   , numFinished (0)
+   , latencySum (0.0)
+   , latencyMax (0.0)
+   , waitSum (0.0)
+   , numInput (0)
+   , inputLatencySum (0.0)
+   , inputLatencyMax (0.0)
+{
+   for (frame& slot : frames) { slot.fence = 0; slot.hasInput = false; }
+}
+
+framePacer::~framePacer()
+{
+   for (frame& slot : frames)
+   {
+      if (slot.fence) { glDeleteSync(slot.fence); }
+   }
+}
+
+void framePacer::finish(frame& done, clock::time_point when)
+{
+   double latency = getMs(when - done.begun);
+
+   latencySum += latency;
+   latencyMax = max(latencyMax, latency);
+
+   ++numFinished;
+
+   if (done.hasInput)
+   {
+      double inputLatency = getMs(when - done.input);
+
+      inputLatencySum += inputLatency;
+      inputLatencyMax = max(inputLatencyMax, inputLatency);
+
+      ++numInput;
+   }
+
+   glDeleteSync(done.fence);
+   done.fence = 0;
+}
+
+void framePacer::poll()
+{
+   //Oldest first; frames finish in order
+   for (GLuint i = 0; i < frames.size(); ++i)
+   {
+      frame& slot = frames[(next + i) % frames.size()];
+
+      if (!slot.fence) { continue; }
+
+      GLenum result = glClientWaitSync(slot.fence, 0, 0);
+
+      if ((result != GL_ALREADY_SIGNALED) && (result != GL_CONDITION_SATISFIED))
+      {
+	 return;
+      }
+
+      finish(slot, clock::now());
+   }
+}
+
+void framePacer::begin()
+{
+   poll();
+
+   frame& slot = frames[next];
+
+   if (slot.fence)
+   {
+      double waited = 0.0;
+
+      waitForFence(slot.fence, waited);
+
+      waitSum += waited * 1000.0;
+
+      //Even on GL_WAIT_FAILED, there's no use waiting on it again
+      finish(slot, clock::now());
+   }
+
+   slot.begun = clock::now();
+   slot.hasInput = false;
+}
+
+void framePacer::end()
+{
+   frames[next].fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+   //Get the GPU started on it, without waiting
+   glFlush();
+
+   LOG_GL();
+
+   next = (next + 1) % frames.size();
+}
+
+void framePacer::setInputTime(clock::time_point when)
+{
+   frames[next].hasInput = true;
+   frames[next].input = when;
+}
+
+void framePacer::report(double periodSeconds)
+{
+   clock::time_point now = clock::now();
+
+   double elapsed = getMs(now - periodStart);
+
+   if (elapsed < periodSeconds * 1000.0) { return; }
+
+   if (numFinished)
+   {
+      cout << (double) numFinished * 1000.0 / elapsed << " fps, latency "
+	   << latencySum / numFinished << "ms avg / " << latencyMax << "ms max, "
+	   << waitSum / numFinished << "ms/frame waiting on the GPU ("
+	   << frames.size() << " in flight)" << endl;
+   }
+
+   if (numInput)
+   {
+      cout << "  input to present " << inputLatencySum / numInput << "ms avg / "
+	   << inputLatencyMax << "ms max, over " << numInput << " frames" << endl;
+   }
+
+   periodStart = now;
+   numFinished = numInput = 0;
+   latencySum = latencyMax = waitSum = 0.0;
+   inputLatencySum = inputLatencyMax = 0.0;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "compute.hpp"
+
+#include <chrono>
+
+class framePacer
+/*
+  Lets the CPU get up to some number of frames ahead of the GPU,
+  rather than waiting for each frame to finish before starting the
+  next. Each frame is fenced once it's been submitted; starting a
+  frame waits for the fence of the one that many frames back.
+
+  It also measures throughput (frames finished per second) and latency
+  (from the CPU starting a frame to the GPU finishing it) - and, for
+  frames given the time of the input they show, from that input to the
+  GPU finishing the frame. Fences are only checked at the start of
+  each frame, so latencies are as seen from there.
+*/
+{
+public:
+   typedef std::chrono::steady_clock clock;
+
+private:
+   struct frame
+   {
+      //0 when not in flight
+      GLsync fence;
+
+      clock::time_point begun;
+
+      //Of the oldest input it's the first to show, if any
+      bool hasInput;
+      clock::time_point input;
+   };
+
+   //A ring; next is the slot for the next frame
+   std::vector<frame> frames;
+   GLuint next;
+
+   //Since the last report
+   clock::time_point periodStart;
+   unsigned int numFinished;
+   double latencySum;
+   double latencyMax;
+   double waitSum;
+   unsigned int numInput;
+   double inputLatencySum;
+   double inputLatencyMax;
+
+   void finish(frame& done, clock::time_point when);
+
+   //Finish any frames whose fences are signalled, without waiting
+   void poll();
+
+public:
+   framePacer(GLuint framesInFlight);
+   ~framePacer();
+
+   //Blocks while there are too many frames in flight
+   void begin();
+   //Fence off the frame since begin()
+   void end();
+
+   //Between begin() and end(): when the input shown by this frame
+   //came in
+   void setInputTime(clock::time_point when);
+
+   //Print stats, if it's been at least periodSeconds since last time
+   void report(double periodSeconds);
+};
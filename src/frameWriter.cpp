@@ -0,0 +1,302 @@
+#include "frameWriter.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+
+#include <zlib.h>
+
+using namespace std;
+
+bool
+writePPM(const string& fileName, int width, int height,
+	 const vector<uint8_t>& rgba)
+{
+   //Binary PPM: just a header, then RGB from the top row down
+   ofstream file(fileName, ofstream::out | ofstream::binary);
+
+   if (!file.is_open())
+   {
+      cerr << "Couldn't write frame \"" << fileName << "\"" << endl;
+
+      return false;
+   }
+
+   file << "P6\n" << width << " " << height << "\n255\n";
+
+   vector<char> row((size_t) width * 3);
+
+   //GL rows go from the bottom up
+   for (int y = height - 1; y >= 0; --y)
+   {
+      const uint8_t* pixel = rgba.data() + (size_t) y * width * 4;
+
+      for (int x = 0; x < width; ++x, pixel += 4)
+      {
+	 row[x * 3] = (char) pixel[0];
+	 row[x * 3 + 1] = (char) pixel[1];
+	 row[x * 3 + 2] = (char) pixel[2];
+      }
+
+      file.write(row.data(), row.size());
+   }
+
+   return (bool) file;
+}
+
+namespace
+{
+   /*
+     Only the first level is worth it: these frames are mostly empty,
+     which any level squeezes well, and past it compressing takes
+     several times as long for a few percent off the file.
+   */
+   const int pngCompression = Z_BEST_SPEED;
+
+   void putBigEndian(vector<uint8_t>& out, uint32_t value)
+   {
+      for (int shift = 24; shift >= 0; shift -= 8) { out.push_back((uint8_t) (value >> shift)); }
+   }
+
+   //Length, type, data and CRC (of the type and data)
+   void putChunk(vector<uint8_t>& out, const char* type, const vector<uint8_t>& data)
+   {
+      putBigEndian(out, (uint32_t) data.size());
+
+      size_t typeStart = out.size();
+
+      out.insert(out.end(), type, type + 4);
+      out.insert(out.end(), data.begin(), data.end());
+
+      uLong crc = crc32(0L, Z_NULL, 0);
+      crc = crc32(crc, out.data() + typeStart, (uInt) (out.size() - typeStart));
+
+      putBigEndian(out, (uint32_t) crc);
+   }
+}
+
+bool
+writePNG(const string& fileName, int width, int height,
+	 const vector<uint8_t>& rgba)
+{
+   //RGB from the top row down, each row after a filter type byte (0
+   //for none)
+   size_t rowBytes = (size_t) width * 3 + 1;
+
+   vector<uint8_t> rows(rowBytes * (size_t) height);
+
+   //GL rows go from the bottom up
+   for (int y = 0; y < height; ++y)
+   {
+      const uint8_t* pixel = rgba.data() + (size_t) (height - 1 - y) * width * 4;
+      uint8_t* row = rows.data() + (size_t) y * rowBytes;
+
+      row[0] = 0;
+
+      for (int x = 0; x < width; ++x, pixel += 4)
+      {
+	 row[1 + x * 3] = pixel[0];
+	 row[1 + x * 3 + 1] = pixel[1];
+	 row[1 + x * 3 + 2] = pixel[2];
+      }
+   }
+
+   vector<uint8_t> compressed(compressBound((uLong) rows.size()));
+   uLongf compressedBytes = (uLongf) compressed.size();
+
+   if (compress2(compressed.data(), &compressedBytes,
+		 rows.data(), (uLong) rows.size(), pngCompression) != Z_OK)
+   {
+      cerr << "Couldn't compress frame \"" << fileName << "\"" << endl;
+
+      return false;
+   }
+
+   compressed.resize(compressedBytes);
+
+   //8 bit RGB, not interlaced
+   vector<uint8_t> header;
+
+   putBigEndian(header, (uint32_t) width);
+   putBigEndian(header, (uint32_t) height);
+
+   const uint8_t rest[] = { 8, 2, 0, 0, 0 };
+   header.insert(header.end(), rest, rest + sizeof(rest));
+
+   const uint8_t signature[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+   vector<uint8_t> png(signature, signature + sizeof(signature));
+
+   putChunk(png, "IHDR", header);
+   putChunk(png, "IDAT", compressed);
+   putChunk(png, "IEND", vector<uint8_t>());
+
+   ofstream file(fileName, ofstream::out | ofstream::binary);
+
+   if (!file.is_open())
+   {
+      cerr << "Couldn't write frame \"" << fileName << "\"" << endl;
+
+      return false;
+   }
+
+   file.write((const char*) png.data(), png.size());
+
+   return (bool) file;
+}
+
+posterFile::posterFile(const string& fileName, int width, int height)
+   : file (fileName, ofstream::out | ofstream::binary | ofstream::trunc)
+   , fileName (fileName)
+   , width (width)
+   , height (height)
+   , headerBytes (0)
+   , failed (false)
+{
+   if (!file.is_open())
+   {
+      throw runtime_error("Couldn't write poster \"" + fileName + "\"");
+   }
+
+   file << "P6\n" << width << " " << height << "\n255\n";
+
+   headerBytes = file.tellp();
+}
+
+void posterFile::writeTile(int x, int y, int tileWidth, int tileHeight,
+			   const vector<uint8_t>& rgba, int rgbaWidth, int rgbaHeight,
+			   int fromX, int fromY)
+{
+   vector<char> row((size_t) tileWidth * 3);
+
+   for (int i = 0; i < tileHeight; ++i)
+   {
+      //GL rows go from the bottom up
+      const uint8_t* pixel = (rgba.data() +
+			      ((size_t) (rgbaHeight - 1 - fromY - i) * rgbaWidth + fromX) * 4);
+
+      for (int j = 0; j < tileWidth; ++j, pixel += 4)
+      {
+	 row[j * 3] = (char) pixel[0];
+	 row[j * 3 + 1] = (char) pixel[1];
+	 row[j * 3 + 2] = (char) pixel[2];
+      }
+
+      //Seeking past the end leaves a gap, filled in by later tiles
+      file.seekp(headerBytes + ((streamoff) (y + i) * width + x) * 3);
+      file.write(row.data(), row.size());
+   }
+
+   if (!file && !failed)
+   {
+      cerr << "Couldn't write to poster \"" << fileName << "\"" << endl;
+
+      failed = true;
+   }
+}
+
+bool posterFile::close()
+{
+   file.close();
+
+   if (!file && !failed)
+   {
+      cerr << "Couldn't finish poster \"" << fileName << "\"" << endl;
+
+      failed = true;
+   }
+
+   return !failed;
+}
+
+frameWriter::frameWriter(unsigned int numThreads, size_t queuePerThread)
+   : maxQueued (0)
+   , stopping (false)
+   , numWritten (0)
+   , numFailed (0)
+   , stalledSeconds (0.0)
+{
+   if (!numThreads)
+   {
+      unsigned int cores = thread::hardware_concurrency();
+
+      numThreads = (cores > 1) ? cores - 1 : 1;
+   }
+
+   maxQueued = max(queuePerThread, (size_t) 1) * numThreads;
+
+   for (unsigned int i = 0; i < numThreads; ++i)
+   {
+      threads.push_back(thread(&frameWriter::work, this));
+   }
+}
+
+frameWriter::~frameWriter() { finish(); }
+
+void frameWriter::work()
+{
+   unique_lock<mutex> held(lock);
+
+   while (true)
+   {
+      queued.wait(held, [&]() { return stopping || !jobs.empty(); });
+
+      //Only once everything's written
+      if (jobs.empty()) { return; }
+
+      job next = move(jobs.front());
+      jobs.pop_front();
+
+      taken.notify_one();
+
+      held.unlock();
+
+      bool written = writePNG(next.fileName, next.width, next.height, next.rgba);
+
+      held.lock();
+
+      if (written) { ++numWritten; } else { ++numFailed; }
+   }
+}
+
+void frameWriter::submit(const string& fileName, int width, int height,
+			 vector<uint8_t>& rgba)
+{
+   unique_lock<mutex> held(lock);
+
+   if (jobs.size() >= maxQueued)
+   {
+      clock::time_point start = clock::now();
+
+      taken.wait(held, [&]() { return jobs.size() < maxQueued; });
+
+      stalledSeconds += chrono::duration<double>(clock::now() - start).count();
+   }
+
+   job next;
+
+   next.fileName = fileName;
+   next.width = width; next.height = height;
+   next.rgba.swap(rgba);
+
+   jobs.push_back(move(next));
+
+   queued.notify_one();
+}
+
+bool frameWriter::finish()
+{
+   {
+      lock_guard<mutex> held(lock);
+
+      stopping = true;
+   }
+
+   queued.notify_all();
+
+   for (thread& t : threads) { t.join(); }
+
+   threads.clear();
+
+   return !numFailed;
+}
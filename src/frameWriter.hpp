@@ -0,0 +1,110 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+//Frames as read back: RGBA, bottom row first. False, having said why,
+//if the file can't be written.
+bool writePPM(const std::string& fileName, int width, int height,
+	      const std::vector<uint8_t>& rgba);
+bool writePNG(const std::string& fileName, int width, int height,
+	      const std::vector<uint8_t>& rgba);
+
+class posterFile
+/*
+  A binary PPM written a tile at a time, for images too big to hold in
+  memory whole. It's uncompressed, so every pixel has a place in the
+  file; each row of a tile is written straight there.
+*/
+{
+private:
+   std::ofstream file;
+   std::string fileName;
+
+   int width, height;
+   std::streamoff headerBytes;
+
+   bool failed;
+
+public:
+   //Throws runtime_error if the file can't be made
+   posterFile(const std::string& fileName, int width, int height);
+
+   /*
+     The part of rgba (an image as read back: RGBA, bottom row first,
+     rgbaWidth wide) from fromX, fromY (from its top left), tileWidth x
+     tileHeight of it, goes at x, y of the poster (also from its top
+     left).
+   */
+   void writeTile(int x, int y, int tileWidth, int tileHeight,
+		  const std::vector<uint8_t>& rgba, int rgbaWidth, int rgbaHeight,
+		  int fromX, int fromY);
+
+   //False, having said so, if anything couldn't be written
+   bool close();
+};
+
+class frameWriter
+/*
+  Writes frames out as PNGs on threads of its own, so the render loop
+  only has to hand them over. Compressing a frame takes longer than
+  rendering one, so several threads work through them at once; they
+  may finish out of order.
+
+  At most queuePerThread frames a thread wait to be written; past
+  that, submit() blocks til one's taken. How long it spends blocked is how far the
+  writers are holding the renderer up.
+*/
+{
+public:
+   typedef std::chrono::steady_clock clock;
+
+private:
+   struct job
+   {
+      std::string fileName;
+      int width, height;
+      std::vector<uint8_t> rgba;
+   };
+
+   std::vector<std::thread> threads;
+
+   //Everything below is guarded by lock
+   std::mutex lock;
+   std::condition_variable queued;
+   std::condition_variable taken;
+
+   std::deque<job> jobs;
+   size_t maxQueued;
+   bool stopping;
+
+   size_t numWritten;
+   size_t numFailed;
+   double stalledSeconds;
+
+   void work();
+
+public:
+   //0 threads for one per core, less one for rendering
+   frameWriter(unsigned int numThreads, size_t queuePerThread);
+   //Waits for everything to be written
+   ~frameWriter();
+
+   //Takes rgba's contents, leaving it empty
+   void submit(const std::string& fileName, int width, int height,
+	       std::vector<uint8_t>& rgba);
+
+   //Wait til everything's written, and stop the threads. False if any
+   //frame couldn't be.
+   bool finish();
+
+   unsigned int getNumThreads() const { return (unsigned int) threads.size(); }
+   double getStalledSeconds() const { return stalledSeconds; }
+};
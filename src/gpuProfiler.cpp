@@ -0,0 +1,262 @@
+#include "../lib/glad/include/glad/glad.h"
+
+#include "gpuProfiler.hpp"
+
+#include <algorithm>
+#include <iomanip>
+
+using namespace std;
+
+//Defined here too, since min() (and vector's constructor) take them
+//by reference
+const GLuint gpuProfiler::historySize;
+const GLuint timestampRing::ringSize;
+
+double getPercentile(vector<double> values, double fraction)
+{
+   size_t index = (size_t) (fraction * (double) (values.size() - 1) + 0.5);
+
+   nth_element(values.begin(), values.begin() + index, values.end());
+
+   return values[index];
+}
+
+timestampRing::timestampRing()
+   : current (0)
+   , recording (false)
+{}
+
+timestampRing::~timestampRing()
+{
+   for (frameQueries& slot : ring)
+   {
+      glDeleteQueries((GLsizei) slot.begins.size(), slot.begins.data());
+      glDeleteQueries((GLsizei) slot.ends.size(), slot.ends.data());
+   }
+}
+
+void timestampRing::prep(GLuint numPairs)
+{
+   ring.resize(ringSize);
+
+   for (frameQueries& slot : ring)
+   {
+      slot.begins.resize(numPairs);
+      slot.ends.resize(numPairs);
+      slot.used.assign(numPairs, false);
+
+      glGenQueries(numPairs, slot.begins.data());
+      glGenQueries(numPairs, slot.ends.data());
+
+      slot.pending = false;
+   }
+
+   LOG_GL();
+}
+
+void timestampRing::collect(const reader& read, bool wait)
+{
+   //Oldest first, since they finish in order; current (if pending)
+   //is from ringSize frames ago.
+   for (GLuint i = 0; i < ring.size(); ++i)
+   {
+      GLuint index = (current + i) % ringSize;
+      frameQueries& slot = ring[index];
+
+      if (!slot.pending) { continue; }
+
+      if (!wait)
+      {
+	 //The frame's end is the last timestamp in it
+	 GLuint available = 0;
+	 glGetQueryObjectuiv(slot.ends.back(), GL_QUERY_RESULT_AVAILABLE, &available);
+
+	 if (!available) { break; }
+      }
+
+      read(index);
+
+      slot.pending = false;
+   }
+
+   LOG_GL();
+}
+
+bool timestampRing::beginFrame()
+{
+   frameQueries& slot = ring[current];
+
+   recording = !slot.pending;
+
+   if (recording) { slot.used.assign(slot.used.size(), false); }
+
+   return recording;
+}
+
+void timestampRing::endFrame()
+{
+   if (recording) { ring[current].pending = true; }
+
+   current = (current + 1) % ringSize;
+}
+
+void timestampRing::stamp(GLuint pair, bool begin)
+{
+   if (!recording) { return; }
+
+   frameQueries& slot = ring[current];
+
+   glQueryCounter(begin ? slot.begins[pair] : slot.ends[pair], GL_TIMESTAMP);
+
+   slot.used[pair] = true;
+}
+
+double timestampRing::getMs(GLuint slot, GLuint pair) const
+{
+   GLuint64 begin = 0, end = 0;
+   glGetQueryObjectui64v(ring[slot].begins[pair], GL_QUERY_RESULT, &begin);
+   glGetQueryObjectui64v(ring[slot].ends[pair], GL_QUERY_RESULT, &end);
+
+   return (double) (end - begin) / 1.0e6;
+}
+
+gpuProfiler::gpuProfiler(const vector<string>& sectionNames, bool enable,
+			 const string& csvFileName)
+   : names (sectionNames)
+   , slotFrames (timestampRing::ringSize, 0)
+   , frameNumber (0)
+   , numSkipped (0)
+   , historyNext (0)
+   , historyCount (0)
+   , lastReport (clock::now())
+   , enabled (enable)
+{
+   if (!enabled) { return; }
+
+   names.push_back("frame");
+
+   GLuint numNames = (GLuint) names.size();
+
+   ring.prep(numNames);
+
+   history.assign(numNames, vector<double>(historySize, 0.0));
+
+   if (csvFileName.size())
+   {
+      csv.open(csvFileName, ofstream::out | ofstream::trunc);
+
+      if (!csv.is_open())
+      {
+	 cerr << "Couldn't open \"" << csvFileName << "\" for profiling output" << endl;
+      }
+
+      else
+      {
+	 csv << "frame";
+
+	 for (const string& name : names) { csv << "," << name << "_ms"; }
+
+	 csv << '\n';
+      }
+   }
+
+   LOG_GL();
+}
+
+void gpuProfiler::read(GLuint slot)
+{
+   if (csv.is_open()) { csv << slotFrames[slot]; }
+
+   for (GLuint section = 0; section < names.size(); ++section)
+   {
+      //Sections a frame didn't use count as 0 there
+      if (!ring.isUsed(slot, section))
+      {
+	 history[section][historyNext] = 0.0;
+
+	 if (csv.is_open()) { csv << ","; }
+
+	 continue;
+      }
+
+      double ms = ring.getMs(slot, section);
+
+      history[section][historyNext] = ms;
+
+      if (csv.is_open()) { csv << "," << ms; }
+   }
+
+   if (csv.is_open()) { csv << '\n'; }
+
+   historyNext = (historyNext + 1) % historySize;
+   historyCount = min(historyCount + 1, historySize);
+}
+
+void gpuProfiler::beginFrame()
+{
+   if (!enabled) { return; }
+
+   ring.collect([this](GLuint slot) { read(slot); });
+
+   ++frameNumber;
+
+   if (!ring.beginFrame()) { ++numSkipped; return; }
+
+   slotFrames[ring.getCurrent()] = frameNumber;
+
+   ring.stamp((GLuint) names.size() - 1, true);
+}
+
+void gpuProfiler::endFrame()
+{
+   if (!enabled) { return; }
+
+   ring.stamp((GLuint) names.size() - 1, false);
+   ring.endFrame();
+
+   LOG_GL();
+}
+
+void gpuProfiler::begin(GLuint section)
+{
+   if (enabled) { ring.stamp(section, true); }
+}
+
+void gpuProfiler::end(GLuint section)
+{
+   if (enabled) { ring.stamp(section, false); }
+}
+
+void gpuProfiler::report(double periodSeconds)
+{
+   if (!enabled) { return; }
+
+   clock::time_point now = clock::now();
+
+   if (chrono::duration<double>(now - lastReport).count() < periodSeconds) { return; }
+
+   lastReport = now;
+
+   if (!historyCount) { return; }
+
+   cout << "GPU times over the last " << historyCount << " frames ("
+	<< numSkipped << " skipped so far), ms:\n"
+	<< "  section       avg    p50    p95    p99\n";
+
+   for (GLuint section = 0; section < names.size(); ++section)
+   {
+      vector<double> times(history[section].begin(),
+			   history[section].begin() + historyCount);
+
+      double sum = 0.0;
+      for (double time : times) { sum += time; }
+
+      cout << "  " << left << setw(10) << names[section] << right << fixed << setprecision(3)
+	   << setw(7) << sum / times.size()
+	   << setw(7) << getPercentile(times, 0.5)
+	   << setw(7) << getPercentile(times, 0.95)
+	   << setw(7) << getPercentile(times, 0.99) << '\n';
+   }
+
+   cout << defaultfloat << setprecision(6) << flush;
+}
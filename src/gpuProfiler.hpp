@@ -0,0 +1,135 @@
+#pragma once
+
+#include "compute.hpp"
+
+#include <chrono>
+#include <fstream>
+#include <functional>
+
+//The value a fraction of the way through values, once sorted (e.g. 0.5
+//for the median)
+double getPercentile(std::vector<double> values, double fraction);
+
+class timestampRing
+/*
+  Frames' timestamp queries (glQueryCounter()), read back a few frames
+  later once their results are there, from a ring of them; as
+  gpuProfiler, benchmark and resolutionScaler time frames.
+
+  Each frame in the ring has numPairs begin and end stamps; the last
+  pair is for the whole frame, so once its end is in, so is every
+  other. A frame whose slot is still waiting on its results when it
+  comes round again isn't stamped, so nothing ever stalls (unless
+  collect() is told to wait).
+*/
+{
+public:
+   //Has to be more than can be in flight at once, or frames will be
+   //skipped
+   static const GLuint ringSize = 8;
+
+   //Given the slot of a frame whose results are in
+   typedef std::function<void(GLuint slot)> reader;
+
+private:
+   struct frameQueries
+   {
+      std::vector<GLuint> begins;
+      std::vector<GLuint> ends;
+      std::vector<bool> used;
+
+      bool pending;
+   };
+
+   std::vector<frameQueries> ring;
+   GLuint current;
+
+   //False for frames whose slot was still pending
+   bool recording;
+
+public:
+   timestampRing();
+   ~timestampRing();
+
+   void prep(GLuint numPairs);
+
+   //Frames whose results are in, oldest first, each through read
+   //(before its slot's reused); with wait, every frame still pending,
+   //waiting for them if need be
+   void collect(const reader& read, bool wait = false);
+
+   //False, and the frame isn't stamped, if its slot's still pending
+   bool beginFrame();
+   void endFrame();
+
+   //In the frame begun, if it's being stamped
+   void stamp(GLuint pair, bool begin);
+
+   //The slot of the frame begun
+   GLuint getCurrent() const { return current; }
+
+   //Of a collected frame's slot: whether pair was stamped, and the time
+   //between its stamps
+   bool isUsed(GLuint slot, GLuint pair) const { return ring[slot].used[pair]; }
+   double getMs(GLuint slot, GLuint pair) const;
+};
+
+class gpuProfiler
+/*
+  Times sections of each frame on the GPU, with timestamp queries
+  (glQueryCounter()) before and after each. Queries are read back a
+  few frames later, once their results are there, from a ring of
+  them; a frame whose slot in the ring is still waiting on results
+  just isn't profiled, so nothing ever stalls.
+
+  Keeps the last historySize times of each section, for rolling
+  averages and percentiles, and optionally writes every frame's times
+  to a CSV file.
+*/
+{
+private:
+   typedef std::chrono::steady_clock clock;
+
+   //Sections, then the whole frame
+   std::vector<std::string> names;
+
+   //A begin and end for each of names
+   timestampRing ring;
+   //Of the frame in each slot
+   std::vector<unsigned long> slotFrames;
+
+   unsigned long frameNumber;
+   unsigned long numSkipped;
+
+   //Milliseconds, per section; ring buffers of historySize
+   std::vector<std::vector<double>> history;
+   GLuint historyNext;
+   GLuint historyCount;
+
+   std::ofstream csv;
+
+   clock::time_point lastReport;
+
+   bool enabled;
+
+   //Of a frame whose results are in (see timestampRing::collect())
+   void read(GLuint slot);
+
+public:
+   static const GLuint historySize = 240;
+
+   //An empty csvFileName writes no CSV
+   gpuProfiler(const std::vector<std::string>& sectionNames, bool enable,
+	       const std::string& csvFileName = "");
+
+   void beginFrame();
+   void endFrame();
+
+   //section indexes sectionNames
+   void begin(GLuint section);
+   void end(GLuint section);
+
+   //Print averages and percentiles, if it's been at least
+   //periodSeconds since last time
+   void report(double periodSeconds);
+};
@@ -0,0 +1,96 @@
+#include "../lib/glad/include/glad/glad.h"
+
+#include "holeFiller.hpp"
+
+//Shader bindings; see fillHoles.c.glsl (and pyramid::reduce())
+static const GLuint sourceBinding = 3;
+static const GLuint targetBinding = 4;
+
+static const GLint sourceXYLoc = 6;
+static const GLint targetXYLoc = 7;
+
+holeFiller::holeFiller(GLuint numLevels)
+   : pull ("resources/shaders/fillHoles.c.glsl", {{"PULL", "1"}})
+   , push ("resources/shaders/fillHoles.c.glsl", {{"PUSH", "1"}})
+   , levels (numLevels)
+{
+   glGetProgramiv(pull.getHandle(), GL_COMPUTE_WORK_GROUP_SIZE, pullSizes);
+   glGetProgramiv(push.getHandle(), GL_COMPUTE_WORK_GROUP_SIZE, pushSizes);
+}
+
+void holeFiller::prep(GLuint width, GLuint height)
+{
+   levels.prep(width, height);
+}
+
+void holeFiller::resize(GLuint width, GLuint height)
+{
+   levels.resize(width, height);
+}
+
+void holeFiller::pushLevelSizes(GLuint sourceX, GLuint sourceY,
+			     GLuint targetX, GLuint targetY)
+{
+   glUniform2ui(sourceXYLoc, sourceX, sourceY);
+   glUniform2ui(targetXYLoc, targetX, targetY);
+}
+
+void holeFiller::dispatch(const int localSizes[3], GLuint targetX, GLuint targetY)
+{
+   uint32_t xWkgps, yWkgps;
+
+   getWkgpDimensions(xWkgps, yWkgps,
+		     localSizes[0], localSizes[1],
+		     targetX, targetY);
+
+   glDispatchCompute(xWkgps, yWkgps, 1);
+
+   //Each level depends on the one before
+   glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+}
+
+void holeFiller::fill(image& samples)
+{
+   GLuint numLevels = levels.getNumLevels();
+
+   if (!numLevels) { return; }
+
+   GLuint samplesX, samplesY;
+   samples.getSize(samplesX, samplesY);
+
+   //Pull: samples -> level 0 -> level 1 ...
+   pull.use();
+
+   levels.reduce(samples, pullSizes);
+
+   //Push: ... level 1 -> level 0 -> samples. (The coarsest level has
+   //nothing above it to fill from.)
+   push.use();
+
+   for (GLuint level = numLevels - 1; level > 0; --level)
+   {
+      GLuint sourceX, sourceY, targetX, targetY;
+
+      levels.getLevelSize(level, sourceX, sourceY);
+      levels.getLevelSize(level - 1, targetX, targetY);
+
+      levels.use(level, sourceBinding, GL_READ_ONLY);
+      levels.use(level - 1, targetBinding, GL_READ_WRITE);
+
+      pushLevelSizes(sourceX, sourceY, targetX, targetY);
+
+      dispatch(pushSizes, targetX, targetY);
+   }
+
+   GLuint sourceX, sourceY;
+   levels.getLevelSize(0, sourceX, sourceY);
+
+   levels.use(0, sourceBinding, GL_READ_ONLY);
+   samples.use(targetBinding, GL_READ_WRITE, GL_R32UI);
+
+   pushLevelSizes(sourceX, sourceY, samplesX, samplesY);
+
+   dispatch(pushSizes, samplesX, samplesY);
+
+   LOG_GL();
+}
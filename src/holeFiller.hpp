@@ -0,0 +1,42 @@
+#pragma once
+
+#include "compute.hpp"
+
+class holeFiller
+/*
+  Fills empty texels in the samples image between the surfelsToSamples
+  and samplesToPixels passes, so that sparse point clouds look solid.
+
+  It pulls the samples up a pyramid of half-size levels, each texel
+  keeping the nearest surface among its 4 children, then pushes back
+  down, filling empty texels from the level above. Each level can
+  close gaps twice as wide as the last, so the number of levels bounds
+  the size of hole filled (and how far silhouettes can spread into
+  the background).
+*/
+{
+private:
+   program pull;
+   program push;
+
+   pyramid levels;
+
+   int pullSizes[3];
+   int pushSizes[3];
+
+   //Upload sizes of the source and target levels of a pass
+   void pushLevelSizes(GLuint sourceX, GLuint sourceY,
+		    GLuint targetX, GLuint targetY);
+
+   void dispatch(const int localSizes[3], GLuint targetX, GLuint targetY);
+
+public:
+   holeFiller(GLuint numLevels);
+
+   void prep(GLuint width, GLuint height);
+
+   void resize(GLuint width, GLuint height);
+
+   //NB rebinds image units 3 and 4
+   void fill(image& samples);
+};
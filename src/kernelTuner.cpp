@@ -0,0 +1,223 @@
+#include "../lib/glad/include/glad/glad.h"
+
+#include "kernelTuner.hpp"
+
+#include <chrono>
+#include <fstream>
+#include <sstream>
+
+using namespace std;
+
+//Runs timed per variant, after one untimed to warm up
+static const unsigned int timedRuns = 5;
+
+kernelConfig::kernelConfig() : localX (0) , localY (0) , perInvocation (1) {}
+
+kernelConfig::kernelConfig(GLuint x, GLuint y, GLuint perInvocation)
+   : localX (x)
+   , localY (y)
+   , perInvocation (perInvocation)
+{}
+
+void kernelConfig::addDefines(shaderDefines& defs) const
+{
+   if (localX) { defs["LOCAL_SIZE_X"] = to_string(localX); }
+   if (localY) { defs["LOCAL_SIZE_Y"] = to_string(localY); }
+
+   defs["POINTS_PER_INVOCATION"] = to_string(perInvocation);
+}
+
+kernelTuner::kernelTuner(const string& cacheFileName)
+   : cacheFileName (cacheFileName)
+{
+   load();
+}
+
+string kernelTuner::getKey(const string& shaderNm, const shaderDefines& defs) const
+{
+   string key = getDeviceCapabilities().getDriverKey() + "|" + shaderNm;
+
+   for (auto& define : defs)
+   {
+      key += "|" + define.first + "=" + define.second;
+   }
+
+   return key;
+}
+
+bool kernelTuner::fitsLimits(const kernelConfig& config) const
+{
+   const deviceCapabilities& caps = getDeviceCapabilities();
+
+   GLuint x = config.localX ? config.localX : 1;
+   GLuint y = config.localY ? config.localY : 1;
+
+   return ((x <= (GLuint) caps.maxWkgpSize[0]) &&
+	   (y <= (GLuint) caps.maxWkgpSize[1]) &&
+	   (x * y <= (GLuint) caps.maxWkgpInvocations));
+}
+
+GLuint64 kernelTuner::time(program& variant, const kernelConfig& config,
+			   const function<void(program&, const kernelConfig&)>& run)
+{
+   //Compilation can be lazy, so the first run may be a lot slower
+   run(variant, config);
+
+   glFinish();
+
+   /*
+     Wall time rather than a GL_TIME_ELAPSED query: some drivers
+     (software ones especially) answer those with nonsense. Waiting for
+     the runs to finish is fine here; nothing else is going on.
+   */
+   auto start = chrono::steady_clock::now();
+
+   for (unsigned int i = 0; i < timedRuns; ++i)
+   {
+      run(variant, config);
+   }
+
+   glFinish();
+
+   auto elapsed = chrono::steady_clock::now() - start;
+
+   LOG_GL();
+
+   return (GLuint64) chrono::duration_cast<chrono::nanoseconds>(elapsed).count();
+}
+
+kernelConfig kernelTuner::choose(const string& shaderNm, const shaderDefines& defs,
+				 const vector<kernelConfig>& candidates,
+				 const function<void(program&, const kernelConfig&)>& run,
+				 bool retune)
+{
+   string key = getKey(shaderNm, defs);
+
+   auto cached = cache.find(key);
+
+   if (!retune && (cached != cache.end())) { return cached->second; }
+
+   kernelConfig best;
+   GLuint64 bestTime = 0;
+   bool found = false;
+
+   for (const kernelConfig& config : candidates)
+   {
+      if (!fitsLimits(config)) { continue; }
+
+      shaderDefines variantDefs = defs;
+      config.addDefines(variantDefs);
+
+      program variant = program(shaderNm, variantDefs);
+
+      GLint linked = 0;
+      glGetProgramiv(variant.getHandle(), GL_LINK_STATUS, &linked);
+
+      if (!linked) { continue; }
+
+      GLuint64 elapsed = time(variant, config, run);
+
+      if (!found || (elapsed < bestTime))
+      {
+	 best = config;
+	 bestTime = elapsed;
+	 found = true;
+      }
+   }
+
+   //Nothing worked; leave it to the shader's fallbacks.
+   if (!found) { return kernelConfig(); }
+
+   cout << "Tuned " << shaderNm << ": " << best.localX << "x" << best.localY
+	<< ", " << best.perInvocation << " per invocation ("
+	<< (double) bestTime / (timedRuns * 1.0e6) << "ms)" << endl;
+
+   cache[key] = best;
+
+   save();
+
+   return best;
+}
+
+void kernelTuner::load()
+{
+   ifstream file;
+   file.open(cacheFileName, ifstream::in);
+
+   //Not there yet; fine
+   if (!file.is_open()) { return; }
+
+   //Key, tab, then the config
+   string line;
+
+   while (getline(file, line))
+   {
+      size_t tab = line.rfind('\t');
+
+      if (tab == string::npos) { continue; }
+
+      istringstream values(line.substr(tab + 1));
+
+      kernelConfig config;
+
+      if (values >> config.localX >> config.localY >> config.perInvocation)
+      {
+	 cache[line.substr(0, tab)] = config;
+      }
+   }
+}
+
+void kernelTuner::save() const
+{
+   ofstream file;
+   file.open(cacheFileName, ofstream::out | ofstream::trunc);
+
+   if (!file.is_open())
+   {
+      cerr << "Couldn't write kernel tuning cache \"" << cacheFileName << "\"" << endl;
+
+      return;
+   }
+
+   for (auto& entry : cache)
+   {
+      const kernelConfig& config = entry.second;
+
+      file << entry.first << '\t'
+	   << config.localX << ' ' << config.localY << ' ' << config.perInvocation << '\n';
+   }
+}
+
+vector<kernelConfig> getSplatCandidates(GLuint clusterSize)
+{
+   vector<kernelConfig> candidates;
+
+   const GLuint widths[] = {32, 64, 128, 256, 512};
+
+   for (GLuint x : widths)
+   {
+      if (clusterSize)
+      {
+	 //Any wider and some of the workgroup would have nothing to draw
+	 if (x <= clusterSize) { candidates.push_back(kernelConfig(x, 1)); }
+
+	 continue;
+      }
+
+      for (GLuint perInvocation = 1; perInvocation <= 8; perInvocation *= 2)
+      {
+	 candidates.push_back(kernelConfig(x, 1, perInvocation));
+      }
+   }
+
+   return candidates;
+}
+
+vector<kernelConfig> getResolveCandidates()
+{
+   //Rows, as before, and tiles - which keep a workgroup's samples
+   //closer together.
+   return {kernelConfig(1024, 1), kernelConfig(256, 1), kernelConfig(64, 1),
+	   kernelConfig(8, 8), kernelConfig(16, 8), kernelConfig(16, 16),
+	   kernelConfig(32, 32)};
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "compute.hpp"
+
+#include <functional>
+
+//One way of running a compute shader: its local sizes, and how many
+//elements each invocation handles.
+struct kernelConfig
+{
+   //0 leaves the size to the shader's own fallback
+   GLuint localX;
+   GLuint localY;
+
+   GLuint perInvocation;
+
+   kernelConfig();
+   kernelConfig(GLuint x, GLuint y, GLuint perInvocation = 1);
+
+   //As LOCAL_SIZE_X, LOCAL_SIZE_Y and POINTS_PER_INVOCATION
+   void addDefines(shaderDefines& defs) const;
+};
+
+class kernelTuner
+/*
+  Picks the fastest of a set of configurations for a shader, by
+  compiling a variant with each and timing it on a benchmark. The
+  winners are kept in a file, keyed by the GPU and driver (and the
+  shader's other defines), so each only has to be timed once on a
+  given machine.
+*/
+{
+private:
+   std::string cacheFileName;
+
+   std::map<std::string, kernelConfig> cache;
+
+   std::string getKey(const std::string& shaderNm, const shaderDefines& defs) const;
+
+   bool fitsLimits(const kernelConfig& config) const;
+
+   //Nanoseconds for some runs of run, after a warm-up
+   GLuint64 time(program& variant, const kernelConfig& config,
+		 const std::function<void(program&, const kernelConfig&)>& run);
+
+   void load();
+   void save() const;
+
+public:
+   kernelTuner(const std::string& cacheFileName);
+
+   /*
+     run should dispatch the program it's given (over the benchmark
+     frame) with the given config, pushing any uniforms it needs
+     first. Candidates over the GL's limits are skipped. With retune,
+     anything cached is ignored and overwritten.
+   */
+   kernelConfig choose(const std::string& shaderNm, const shaderDefines& defs,
+		       const std::vector<kernelConfig>& candidates,
+		       const std::function<void(program&, const kernelConfig&)>& run,
+		       bool retune);
+};
+
+//Candidates for surfelsToSamples; with clusters, a workgroup draws a
+//whole cluster, so there's no choosing points per invocation.
+std::vector<kernelConfig> getSplatCandidates(GLuint clusterSize);
+
+//Candidates for samplesToPixels
+std::vector<kernelConfig> getResolveCandidates();
@@ -0,0 +1,153 @@
+#include "../lib/glad/include/glad/glad.h"
+
+#include "liveSurfels.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+using namespace std;
+
+liveSurfels::liveSurfels()
+   : mapped (nullptr)
+   , slotSurfels (0)
+   , oldest (0)
+   , numLive (0)
+   , numSurfels (0)
+   , localX (64)
+   , localY (1)
+   , perInvocation (1)
+   , numAppended (0)
+   , numUploaded (0)
+   , waitSeconds (0.0)
+{}
+
+liveSurfels::~liveSurfels()
+{
+   for (slot& s : ring)
+   {
+      if (s.retired) { glDeleteSync(s.retired); }
+   }
+}
+
+void liveSurfels::prep(GLuint numSlots, size_t nuSlotSurfels,
+		       GLuint surfelsBinding, GLuint instancesBinding)
+{
+   slotSurfels = nuSlotSurfels;
+
+   ring.assign(numSlots ? numSlots : 1, slot{0, 0});
+
+   size_t bytes = ring.size() * slotSurfels * 4 * sizeof(float);
+
+   mapped = (float*) surfels.prepMapped(bytes, surfelsBinding);
+
+   if (!mapped) { throw runtime_error("Couldn't map the buffer for live surfels"); }
+
+   //A row per slot, whether or not it's live (see update())
+   vector<sceneInstance> table(ring.size());
+
+   instances.prep(table.data(), table.size() * sizeof(sceneInstance), instancesBinding);
+
+   update();
+
+   LOG_GL();
+}
+
+void liveSurfels::update()
+{
+   vector<sceneInstance> table(ring.size());
+
+   const GLfloat identity[16] = {1.f, 0.f, 0.f, 0.f,
+				 0.f, 1.f, 0.f, 0.f,
+				 0.f, 0.f, 1.f, 0.f,
+				 0.f, 0.f, 0.f, 1.f};
+
+   numSurfels = 0;
+
+   for (GLuint i = 0; i < ring.size(); ++i)
+   {
+      sceneInstance& row = table[i];
+
+      copy(identity, identity + 16, row.transform);
+      row.scale = 1.f;
+
+      if (i < numLive)
+      {
+	 GLuint index = (oldest + i) % ring.size();
+
+	 row.first = (GLuint) (index * slotSurfels);
+	 row.count = ring[index].count;
+      }
+
+      //Past the live ones, empty rows starting after every surfel,
+      //which the shader's search never lands on
+      else { row.first = 0; row.count = 0; }
+
+      row.start = (GLuint) numSurfels;
+
+      numSurfels += row.count;
+   }
+
+   instances.write(table.data(), 0, table.size() * sizeof(sceneInstance));
+
+   planInstanced(renderPlan, numSurfels, localX, localY, perInvocation);
+}
+
+void liveSurfels::append(const float* data, size_t count)
+{
+   if (numLive == ring.size()) { expire(); }
+
+   GLuint index = (oldest + numLive) % ring.size();
+
+   slot& s = ring[index];
+
+   if (s.retired)
+   {
+      waitForFence(s.retired, waitSeconds);
+
+      glDeleteSync(s.retired);
+      s.retired = 0;
+   }
+
+   s.count = (GLuint) min(count, slotSurfels);
+
+   memcpy(mapped + index * slotSurfels * 4, data, s.count * 4 * sizeof(float));
+
+   ++numLive;
+   ++numAppended;
+   numUploaded += s.count;
+
+   update();
+
+   LOG_GL();
+}
+
+void liveSurfels::expire()
+{
+   if (!numLive) { return; }
+
+   slot& s = ring[oldest];
+
+   //Behind every frame that might draw it
+   s.retired = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+   s.count = 0;
+
+   oldest = (oldest + 1) % ring.size();
+   --numLive;
+
+   update();
+
+   LOG_GL();
+}
+
+void liveSurfels::planRender(int nuLocalX, int nuLocalY, int nuPerInvocation)
+{
+   localX = nuLocalX; localY = nuLocalY; perInvocation = nuPerInvocation;
+
+   planInstanced(renderPlan, numSurfels, localX, localY, perInvocation);
+}
+
+void liveSurfels::render()
+{
+   if (numSurfels) { renderPlan.dispatch(); }
+}
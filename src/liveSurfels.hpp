@@ -0,0 +1,94 @@
+#pragma once
+
+#include "compute.hpp"
+#include "surfelScene.hpp"
+
+#include <vector>
+
+class liveSurfels
+/*
+  Surfels that come and go while they're drawn, e.g. a sensor's
+  sweeps. The buffer is a ring of slots, each holding one sweep of up
+  to slotSurfels. append() writes a sweep into the next slot straight
+  through a persistent mapping (see buffer::prepMapped()), so only the
+  sweep itself is ever uploaded, never the whole; expire() retires the
+  oldest.
+
+  Live sweeps are drawn as instances (see surfelScene): a row of the
+  table each, in the order they came in, so one dispatch draws them
+  all wherever they are in the ring.
+
+  Frames already submitted may still be drawing a sweep when it's
+  retired, so retiring fences its slot; the next append() into it
+  waits on the fence (if it must) before writing. With more slots
+  spare, beyond the sweeps kept live, than there are frames in flight,
+  it never has to.
+*/
+{
+private:
+   struct slot
+   {
+      GLuint count;
+      //Since it was retired; 0 once it's safe to write
+      GLsync retired;
+   };
+
+   buffer surfels;
+   float* mapped;
+
+   buffer instances;
+
+   std::vector<slot> ring;
+   size_t slotSurfels;
+
+   //Live sweeps: the oldest, and how many from there
+   GLuint oldest;
+   GLuint numLive;
+   size_t numSurfels;
+
+   //surfelsToSamples' local sizes, as last planned with
+   int localX, localY, perInvocation;
+   dispatchPlan renderPlan;
+
+   size_t numAppended;
+   size_t numUploaded;
+   double waitSeconds;
+
+   //The table and the plan, after sweeps come or go
+   void update();
+
+public:
+   liveSurfels();
+   ~liveSurfels();
+
+   //Throws runtime_error if the buffer can't be mapped
+   void prep(GLuint numSlots, size_t slotSurfels,
+	     GLuint surfelsBinding, GLuint instancesBinding);
+
+   /*
+     A sweep of numSurfels, as 4 floats each (xyz, then radius), cut
+     short at slotSurfels. With every slot live, the oldest is retired
+     to make room.
+   */
+   void append(const float* data, size_t numSurfels);
+
+   //The oldest sweep, if there are any
+   void expire();
+
+   //As surfelModel::planRender(); kept for when sweeps come or go
+   void planRender(int localX, int localY, int perInvocation = 1);
+
+   //Nothing, with no sweeps live
+   void render();
+
+   //Drawn each frame, over every live sweep
+   size_t getNumSurfels() const { return numSurfels; }
+   GLuint getNumSweeps() const { return numLive; }
+   size_t getSlotSurfels() const { return slotSurfels; }
+
+   //Since prep(), the surfels in them, and the time append() spent
+   //waiting on the GPU for them
+   size_t getNumAppended() const { return numAppended; }
+   size_t getNumUploaded() const { return numUploaded; }
+   double getWaitSeconds() const { return waitSeconds; }
+};
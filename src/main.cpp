@@ -5,15 +5,31 @@
 #include "../lib/geom/geom.h"
 #undef GEOM_IMPL
 
-#include "compute.hpp"
-#include "projection.hpp"
-#include "pcdReader.hpp"
+#include "renderer.hpp"
 #include "sdl_utils.hpp"
+#include "egl_utils.hpp"
+#include "framePacer.hpp"
+#include "cameraPath.hpp"
+#include "benchmark.hpp"
+#include "snapshot.hpp"
+#include "resolutionScaler.hpp"
+#include "frameWriter.hpp"
+#include "readbackRing.hpp"
+#include "videoWriter.hpp"
+#include "sweepSocket.hpp"
+#include "pcdReader.hpp"
 
+#include <atomic>
+#include <chrono>
+#include <cstdio>
 #include <cstring>
+#include <exception>
+#include <thread>
+
+using namespace std;
 
-#define errorGL() printErrorGL(__FILE__, __LINE__)
-#define LOG_GL() logErrorGL(__LINE__)
+//Linked programs' binaries (see program::prep())
+static const char* programCacheDirectory = "build";
 
 bool
 handleEvents(sdlInstance& inst, camera& cam)
@@ -65,188 +81,993 @@ handleEvents(sdlInstance& inst, camera& cam)
    return cameraMoved;
 }
 
-bool
-handleWindowResize(sdlInstance& inst,
-		   int& winX, int& winY,
-		   image& samples, image& pixels)
+void
+reportBenchmark(benchmark& bench, const options& opts, const renderer& pipeline)
 {
-   bool cameraMoved = false;
+   bench.finish();
+
+   bench.report(pipeline.getNumSurfels());
+
+   if (!opts.benchmarkFileName.size()) { return; }
+
+   //Whatever makes runs differ, besides the build and the GPU
+   map<string, string> settings;
+
+   settings["model"] = opts.modelFileName;
+   settings["scene"] = opts.sceneFileName;
+   settings["size"] = to_string(opts.width) + "x" + to_string(opts.height);
+   settings["supersample"] = to_string(opts.supersample);
+   settings["fill_levels"] = to_string(opts.fillLevels);
+   settings["splat"] = opts.splat ? "1" : "0";
+   settings["cull"] = opts.cull ? "1" : "0";
+   settings["tune"] = opts.tune ? "1" : "0";
+   settings["frames_in_flight"] = to_string(opts.framesInFlight);
+   settings["headless"] = opts.headless ? "1" : "0";
+   settings["replay"] = opts.replayFileName;
+
+   switch (opts.filter)
+   {
+      case resolveFilter::none: { settings["filter"] = "none"; } break;
+      case resolveFilter::box: { settings["filter"] = "box"; } break;
+      case resolveFilter::tent: { settings["filter"] = "tent"; } break;
+   }
+
+   if (bench.writeJSON(opts.benchmarkFileName, pipeline.getNumSurfels(), settings))
+   {
+      cout << "Wrote benchmark results to " << opts.benchmarkFileName << endl;
+   }
+}
+
+/*
+  Memory traffic presenting directly saves each frame: the pixels
+  image isn't written by the resolve, cleared, or read by the blit (4
+  bytes a pixel each). The window's written either way.
+*/
+void
+printPresentSavings(int width, int height)
+{
+   double megabytes = 3.0 * 4.0 * (double) width * (double) height / (1024.0 * 1024.0);
+
+   cout << "Presenting directly: " << megabytes << "MB a frame less to write and read at "
+	<< width << "x" << height << endl;
+}
+
+/*
+  What streaming the model in took: the sweeps uploaded, against
+  uploading the whole model each time one came in. Listening, there's
+  no model, and the sweeps are at most the size given.
+*/
+void
+printLiveStats(const options& opts, const renderer& pipeline)
+{
+   const liveSurfels& live = pipeline.getLive();
+
+   bool listening = opts.listenAddress.size();
+
+   //Less the ones the renderer started with
+   size_t numSweeps = live.getNumAppended() - (listening ? 0 : opts.liveSweeps);
+
+   double sweepMegabytes = (double) live.getSlotSurfels() * 4.0 * sizeof(float) / (1024.0 * 1024.0);
+
+   cout << "Streamed " << numSweeps << " sweep(s) of " << (listening ? "up to " : "")
+	<< live.getSlotSurfels() << " surfels: ";
+
+   //The model's sweeps fill their slots (but the last); a sensor's
+   //needn't
+   if (listening)
+   {
+      cout << (double) live.getNumUploaded() * 4.0 * sizeof(float) / (1024.0 * 1024.0) << "MB uploaded";
+   }
+
+   else { cout << (double) numSweeps * sweepMegabytes << "MB uploaded"; }
+
+   if (!listening)
+   {
+      cout << ", rather than " << (double) numSweeps * sweepMegabytes * opts.liveSweeps
+	   << "MB re-uploading the model";
+   }
+
+   cout << "; waited " << live.getWaitSeconds() << "s for slots the GPU was still drawing" << endl;
+}
+
+//What the input thread hands the render thread, whenever it changes
+struct inputState
+{
+   cameraPose pose;
+   int width, height;
+
+   //When the oldest input not yet rendered came in
+   framePacer::clock::time_point time;
+   unsigned long sequence;
+};
+
+//How long the input thread waits for events at a time; input can't be
+//shown any sooner than this after it's come in.
+static const int inputWaitMs = 1;
+
+//Frames captured to video that wait for the encoder thread, at most
+static const size_t captureQueued = 4;
+
+//Sweeps the receiver fills and holds for the render thread: one
+//coming in, and a few waiting
+static const size_t sweepBuffers = 4;
+
+//How long a headless frame waits for the next sweep from the socket
+static const double sweepWaitSeconds = 1.0;
+
+void
+renderWindowed(const options& opts, sdlInstance& instance, cameraPath& path,
+	       snapshot<inputState>& latest, atomic<unsigned long>& rendered,
+	       atomic<bool>& quit)
+{
+   bool replaying = opts.replayFileName.size();
+   bool recording = opts.recordFileName.size();
+
+   //Replays are benchmarks along a path
+   bool timing = replaying || opts.benchmark;
+
+   inputState input;
+   //The first take() always gets something (see snapshot())
+   latest.take(input);
+
+   int winX = input.width; int winY = input.height;
+
+   //From here on, the GL is this thread's
+   instance.makeContextCurrent();
+
+   //Debug builds get GL errors from a callback (see LOG_GL())
+   prepDebugOutputGL();
+
+   renderer pipeline(opts, winX, winY);
+
+   //Framebuffer stuff
+   framebuffer frame; LOG_GL();
    
-   if (inst.hasWindowChanged(winX, winY))
+   frame.prep(pipeline.getPixels()); LOG_GL();
+
+   frame.use(); LOG_GL();
+
+   printProgramCacheStats();
+
+   if (opts.directPresent) { printPresentSavings(winX, winY); }
+
+   framePacer pacer = framePacer(opts.framesInFlight);
+
+   gpuProfiler profiler(profiledPassNames, opts.profile, opts.profileFileName);
+
+   benchmark bench(timing,
+		   replaying ? path.getNumFrames() : opts.numFrames,
+		   opts.numSeconds);
+
+   //Off unless there's a frame time to hold
+   resolutionScaler scaler(opts.targetFrameMs, opts.minScale);
+
+   /*
+     Capturing reads each frame back into a ring deep enough that the
+     GPU's always done with the oldest by the time it's taken, so the
+     render thread only copies out a finished frame and hands it to
+     the encoder's thread.
+   */
+   bool capturing = opts.captureFileName.size();
+
+   readbackRing capture(capturing ? opts.framesInFlight + 2 : 1);
+
+   //Off without a file name
+   videoWriter video(opts.captureFileName, opts.captureFps, captureQueued);
+
+   vector<uint8_t> captured;
+
+   //Live, when the next sweep's due
+   framePacer::clock::duration sweepPeriod =
+      chrono::duration_cast<framePacer::clock::duration>(chrono::duration<double>(1.0 / opts.liveRate));
+
+   framePacer::clock::time_point nextSweep = framePacer::clock::now() + sweepPeriod;
+
+   //Or as they come in on a socket; off without an address
+   sweepReceiver receiver(opts.listenAddress, opts.maxSweepSurfels, sweepBuffers);
+
+   vector<float> sweep;
+   size_t sweepSurfels;
+
+   //On the render thread, for all frames
+   double captureSeconds = 0.0;
+   double frameSeconds = 0.0;
+
+   auto encodeOldest = [&](bool wait)
    {
-      //These also do associated uniforms
-      samples.resize(winX * 2, winY * 2);
-      pixels.resize(winX, winY);
+      GLint width, height;
+      size_t number;
 
-      //Don't update aspect ratio based on new sizes though - it's weird.
+      if (!capture.take(captured, width, height, number, wait)) { return false; }
 
-      //Perspective matrix will need re-uniforming since it
-      //will have aspect ratio baked in
-      cameraMoved = true;
-	 
-      //Framebuffer seems not to need re-connecting to texture, either.
+      video.submit(width, height, captured);
+
+      return true;
+   };
+
+   size_t frameNumber = 0;
+
+   while (!quit.load() && !bench.done())
+   {
+      //Wait (if need be) before taking input, so it's as fresh as
+      //it can be.
+      pacer.begin();
+      profiler.beginFrame();
+      bench.beginFrame();
+
+      framePacer::clock::time_point frameStart = framePacer::clock::now();
+
+      camera& cam = pipeline.getCamera();
+
+      bool cameraMoved = false;
+
+      if (latest.take(input))
+      {
+	 rendered.store(input.sequence);
+
+	 cam.setPose(input.pose);
+	 cameraMoved = true;
+
+	 pacer.setInputTime(input.time);
+      }
+
+      //Input still quits, but doesn't steer
+      if (replaying)
+      {
+	 cam.setPose(path.getPose(frameNumber));
+
+	 cameraMoved = true;
+      }
+
+      else if (recording) { path.record(cam.getPose()); }
+
+      bool resized = (input.width != winX) || (input.height != winY);
+
+      //Or the GPU's been too slow (or fast) at the size it's rendering
+      bool rescaled = scaler.update();
+
+      //If the window's size has changed, size of buffers must change
+      //with it. (This re-uniforms the camera itself.)
+      if (resized || rescaled)
+      {
+	 winX = input.width; winY = input.height;
+
+	 int renderX, renderY;
+	 scaler.getSize(winX, winY, renderX, renderY);
+
+	 pipeline.resize(renderX, renderY);
+
+	 //The pixels may be in another texture
+	 frame.attach(pipeline.getPixels());
+	 frame.use();
+      }
+
+      else if (cameraMoved) { pipeline.updateCamera(); }
+
+      //However many have come in since the last frame; but if frames
+      //are slower than sweeps, sweeps that would be replaced before
+      //they're seen are skipped
+      if (opts.listenAddress.size())
+      {
+	 //Likewise, only the newest, so a frame never appends more than
+	 //one (and never waits for a slot)
+	 receiver.skipToNewest();
+
+	 if (receiver.take(sweep, sweepSurfels)) { pipeline.appendLive(sweep.data(), sweepSurfels); }
+      }
+
+      else if (opts.liveSweeps && (framePacer::clock::now() >= nextSweep))
+      {
+	 pipeline.feedLive();
+
+	 nextSweep = max(nextSweep + sweepPeriod, framePacer::clock::now());
+      }
+
+      //Frames that draw nothing say nothing of how fast drawing is
+      bool timed = !pipeline.isSettled();
+
+      if (timed) { scaler.beginFrame(); }
+
+      pipeline.draw(profiler);
+
+      if (opts.directPresent)
+      {
+	 profiler.begin(passPresent);
+	 pipeline.present();
+	 profiler.end(passPresent);
+      }
+
+      else
+      {
+	 profiler.begin(passBlit);
+	 pipeline.getPixels().blit(frame, winX, winY);
+	 profiler.end(passBlit);
+      }
+
+      if (capturing)
+      {
+	 framePacer::clock::time_point captureStart = framePacer::clock::now();
+
+	 //No room for another: the oldest has to come out first
+	 if (capture.full()) { encodeOldest(true); }
+
+	 profiler.begin(passReadback);
+	 capture.read(pipeline.getPixels(), frame, frameNumber);
+	 profiler.end(passReadback);
+
+	 //Whatever else is ready, without waiting
+	 while (encodeOldest(false)) {}
+
+	 captureSeconds += chrono::duration<double>(framePacer::clock::now() - captureStart).count();
+      }
+
+      instance.swapWindow(); LOG_GL();
+
+      //Clear for next frame. These are queued behind this frame's
+      //resolve and blit, so the next frame can be recorded while
+      //those are still running.
+      profiler.begin(passClear);
+
+      pipeline.clear();
+      
+      glClear(GL_COLOR_BUFFER_BIT); LOG_GL();
+
+      profiler.end(passClear);
+
+      if (timed) { scaler.endFrame(); }
+
+      bench.endFrame();
+      profiler.endFrame();
+      pacer.end();
+
+      frameSeconds += chrono::duration<double>(framePacer::clock::now() - frameStart).count();
+
+      ++frameNumber;
+
+      if (opts.frameStats) { pacer.report(2.0); scaler.report(2.0); }
+      profiler.report(2.0);
    }
 
-   return cameraMoved;
+   if (capturing)
+   {
+      while (encodeOldest(true)) {}
+
+      video.finish();
+
+      double frames = frameNumber ? (double) frameNumber : 1.0;
+
+      cout << "Captured " << video.getNumWritten() << " frame(s) to "
+	   << opts.captureFileName << " (skipped " << video.getNumSkipped()
+	   << " after resizing), " << captureSeconds / frames * 1000.0
+	   << "ms a frame on the render thread ("
+	   << (frameSeconds > 0.0 ? captureSeconds / frameSeconds * 100.0 : 0.0)
+	   << "% of frame time); waited " << capture.getWaitSeconds() << "s for the GPU, "
+	   << video.getStalledSeconds() << "s for the encoder" << endl;
+   }
+
+   getTexturePool().printStats();
+
+   receiver.stop();
+   receiver.printStats();
+
+   if (opts.liveSweeps) { printLiveStats(opts, pipeline); }
+
+   if (timing) { reportBenchmark(bench, opts, pipeline); }
 }
 
 int
-main(int argc, char** args)
+runWindowed(const options& opts)
 {
-   SDL_SetMainReady();
+   /*
+     Input is handled on this thread and rendering on another, so a
+     slow frame doesn't hold up input: the camera keeps up with the
+     mouse and keys, and each frame shows wherever it's got to. The
+     render thread gets the camera (and window size) from a snapshot,
+     so neither thread ever waits on the other.
 
-   int winX = 960; int winY = 540;
-   
-   sdlInstance instance = sdlInstance(winX, winY);
+     SDL wants its events handled on the thread that made the window,
+     so it's rendering that moves.
+   */
+   int winX = opts.width; int winY = opts.height;
 
-   program surfelsToSamples = program("resources/shaders/surfelsToSamples.c.glsl");
-   
-   program samplesToPixels = program("resources/shaders/samplesToPixels.c.glsl");
+   cameraPath path;
 
-   LOG_GL();
+   if (opts.replayFileName.size()) { path.load(opts.replayFileName); }
 
-   //Get the local sizes from those shaders.
-   int surfelsToSamplesSizes[3];
-   int samplesToPixelsSizes[3];
-   glGetProgramiv(surfelsToSamples.getHandle(), GL_COMPUTE_WORK_GROUP_SIZE, surfelsToSamplesSizes);
-   glGetProgramiv(samplesToPixels.getHandle(), GL_COMPUTE_WORK_GROUP_SIZE, samplesToPixelsSizes);
+   //Timings shouldn't be capped by waiting on the display
+   sdlInstance instance = sdlInstance(winX, winY,
+				      !(opts.replayFileName.size() || opts.benchmark));
 
-   //Programs have to be used while uniforms are loaded
-   surfelsToSamples.use();
-   //The first 2 arguments are ad hoc bindings, from the shaders - for wid/height
-   image samples = image(3);
-   
-   LOG_GL();
+   //The input side's own camera, which only moves (and isn't ever
+   //pushed to a program)
+   camera cam = getStartCamera(-1, (float) winX / (float) winY);
+
+   inputState input;
 
-   samplesToPixels.use();
-   image pixels = image(5);
+   instance.hasWindowChanged(winX, winY);
 
-   LOG_GL();
+   input.pose = cam.getPose();
+   input.width = winX; input.height = winY;
+   input.time = framePacer::clock::now();
+   input.sequence = 0;
 
-   surfelsToSamples.use();
-   samples.prep(winX * 2, winY * 2);
+   snapshot<inputState> latest(input);
 
-   samplesToPixels.use();
-   pixels.prep(winX, winY);
+   atomic<unsigned long> rendered(0);
+   atomic<bool> quit(false);
 
-   LOG_GL();
+   exception_ptr renderError;
 
-   //Bind images to texture units
-   samples.use(1, GL_READ_WRITE);
-   pixels.use(2, GL_WRITE_ONLY);
+   instance.releaseContext();
 
-   LOG_GL();
+   thread renderThread([&]()
+   {
+      try { renderWindowed(opts, instance, path, latest, rendered, quit); }
 
-   surfelModel surfels; LOG_GL();
+      catch (...) { renderError = current_exception(); }
 
-   const GLuint surfelsBinding = 3;
-   std::string fileName = "resources/models/";
-   
-   if (argc > 1)
+      //Benchmarks end themselves
+      quit.store(true);
+   });
+
+   while (!quit.load())
    {
-      fileName = fileName + args[1];
+      instance.waitEvents(inputWaitMs);
+
+      if (instance.getQuit()) { break; }
+
+      bool changed = handleEvents(instance, cam);
+
+      changed = instance.hasWindowChanged(winX, winY) or changed;
+
+      if (!changed) { continue; }
+
+      //Keep the time of the oldest change that's not been rendered
+      //yet; that's how long this input's been waiting.
+      if (rendered.load() == input.sequence) { input.time = framePacer::clock::now(); }
+
+      input.pose = cam.getPose();
+      input.width = winX; input.height = winY;
+      ++input.sequence;
+
+      latest.publish(input);
    }
 
-   else fileName = "resources/models/ism_train_horse.pcd";
+   quit.store(true);
 
-   try
+   renderThread.join();
+
+   if (renderError) { rethrow_exception(renderError); }
+
+   if (opts.recordFileName.size()) { path.save(opts.recordFileName); }
+
+   printErrorsGL();
+
+   return 0;
+}
+
+int
+runHeadless(const options& opts)
+{
+   cameraPath path;
+
+   bool replaying = opts.replayFileName.size();
+   bool timing = replaying || opts.benchmark;
+
+   //A frame per pose, if following a path; one, if not told
+   //otherwise.
+   size_t numFrames = opts.numFrames;
+
+   if (replaying)
    {
-      surfels.prep(fileName, surfelsBinding);
+      path.load(opts.replayFileName);
+
+      numFrames = path.getNumFrames();
    }
-   
-   catch (const exception& err)
+
+   else if (!numFrames && (opts.numSeconds == 0.f)) { numFrames = 1; }
+
+   eglInstance context;
+
+   prepDebugOutputGL();
+
+   renderer pipeline(opts, opts.width, opts.height);
+
+   //Read back through, rather than blitted from
+   framebuffer frame; LOG_GL();
+
+   frame.prep(pipeline.getPixels()); LOG_GL();
+
+   printProgramCacheStats();
+
+   gpuProfiler profiler(profiledPassNames, opts.profile, opts.profileFileName);
+
+   benchmark bench(timing, numFrames, opts.numSeconds);
+
+   //Benchmarks don't read frames back, so can get ahead of the GPU
+   //as the windowed demo does.
+   framePacer pacer = framePacer(opts.framesInFlight);
+
+   vector<uint8_t> rgba;
+
+   //Off without an address
+   sweepReceiver receiver(opts.listenAddress, opts.maxSweepSurfels, sweepBuffers);
+
+   vector<float> sweep;
+   size_t sweepSurfels;
+
+   for (size_t i = 0; !bench.done(); ++i)
    {
-      cerr << err.what() << endl;
+      if (opts.benchmark) { pacer.begin(); }
+
+      profiler.beginFrame();
+      bench.beginFrame();
+
+      if (replaying)
+      {
+	 pipeline.getCamera().setPose(path.getPose(i));
+	 pipeline.updateCamera();
+      }
+
+      //A sweep a frame, so frames are the same from run to run; the
+      //first has the ones the renderer started with
+      if (opts.listenAddress.size())
+      {
+	 //Each as it comes in, in turn; drawing what there is if it's
+	 //slow to
+	 if (receiver.take(sweep, sweepSurfels, sweepWaitSeconds))
+	 {
+	    pipeline.appendLive(sweep.data(), sweepSurfels);
+	 }
+      }
+
+      else if (i) { pipeline.feedLive(); }
+
+      pipeline.draw(profiler);
+
+      //Waits for the frame; with nothing to show it on, there's no
+      //use getting ahead.
+      if (!opts.benchmark)
+      {
+	 profiler.begin(passReadback);
+	 pipeline.getPixels().read(frame, rgba);
+	 profiler.end(passReadback);
+      }
+
+      profiler.begin(passClear);
+      pipeline.clear();
+      profiler.end(passClear);
+
+      bench.endFrame();
+      profiler.endFrame();
+
+      if (opts.benchmark) { pacer.end(); }
+
+      else
+      {
+	 char suffix[32];
+	 snprintf(suffix, sizeof(suffix), "-%04zu.ppm", i);
+
+	 if (!writePPM(opts.outputPrefix + suffix, opts.width, opts.height, rgba))
+	 {
+	    printErrorsGL();
+
+	    return 1;
+	 }
+      }
+
+      if (opts.frameStats) { pacer.report(2.0); }
+      profiler.report(2.0);
+   }
 
-      return 1;
+   receiver.stop();
+   receiver.printStats();
+
+   if (opts.liveSweeps) { printLiveStats(opts, pipeline); }
+
+   if (!opts.benchmark)
+   {
+      cout << "Wrote " << bench.getNumFrames() << " frame(s) to "
+	   << opts.outputPrefix << "-*.ppm" << endl;
    }
 
-   LOG_GL();
+   if (timing) { reportBenchmark(bench, opts, pipeline); }
 
-   //Framebuffer stuff
+   printErrorsGL();
+
+   return 0;
+}
+
+//Frames being read back at once; more than the GPU gets behind by
+static const GLuint batchReadbacks = 3;
+
+//Frames waiting to be written, per writer thread
+static const size_t batchQueuePerWriter = 2;
+
+/*
+  Renders a frame for every pose in a file, as fast as it can, and
+  writes them as PNGs. The model's only loaded (and the programs only
+  built) once for the lot.
+
+  Nothing waits on anything it needn't: frames are read back through a
+  readbackRing, so the GPU goes on to the next frame while the last
+  is copied out, and handed to a frameWriter, whose threads compress
+  and write them while later frames render. The loop only stalls when
+  the GPU is behind (waiting on a readback) or the writers are (their
+  queue's full); both are reported.
+*/
+int
+runBatch(const options& opts)
+{
+   cameraPath path;
+
+   path.load(opts.batchFileName);
+
+   eglInstance context;
+
+   prepDebugOutputGL();
+
+   renderer pipeline(opts, opts.width, opts.height);
+
+   //Read back through
    framebuffer frame; LOG_GL();
-   
-   frame.prep(pixels); LOG_GL();
 
-   frame.use(); LOG_GL();
+   frame.prep(pipeline.getPixels()); LOG_GL();
+
+   printProgramCacheStats();
+
+   gpuProfiler profiler(profiledPassNames, opts.profile, opts.profileFileName);
 
-   //Uniform stuff for the first time (e.g. perspective matrix)
-   GLint perspectiveLoc = glGetUniformLocation(surfelsToSamples.getHandle(),
-					       "perspective");
+   readbackRing readback(batchReadbacks);
 
-   LOG_GL();
+   //As many threads as there are cores to spare
+   frameWriter writer(0, batchQueuePerWriter);
 
-   camera cam = camera(perspectiveLoc,
-		       geom::vec3(0.0, 0.0, -500.0), //pos
-		       geom::vec3(0.0, 0.0, 1.0), //dirZ
-		       geom::vec3(0.0, 1.0, 0.0), //dirY
-		       35.f, //horizontal fov
-		       pixels.getAspectRatio(), //aspect ratio
-		       1.f, 1000.f); //near, planes z
+   unsigned int numWriters = writer.getNumThreads();
 
-   LOG_GL();
+   //With temporal accumulation, each pose takes the frames to settle
+   GLuint framesPerPose = pipeline.getFramesToSettle();
 
-   surfelsToSamples.use();
-   cam.pushTransformMatrix();
+   size_t numPoses = path.getNumFrames();
 
-   LOG_GL();
+   vector<uint8_t> rgba;
 
-   while (!instance.getQuit())
+   //Hand the oldest frame read back to the writers
+   auto writeOldest = [&](bool wait)
    {
-      instance.pollEvents();
+      GLint width, height;
+      size_t pose;
 
-      bool cameraMoved = handleEvents(instance, cam);
+      if (!readback.take(rgba, width, height, pose, wait)) { return false; }
 
-      //If the window's size has changed, size of buffers must change
-      //with it.
-      cameraMoved = (handleWindowResize(instance,
-					winX, winY,
-					samples, pixels) or
-		     cameraMoved);
+      char suffix[32];
+      snprintf(suffix, sizeof(suffix), "-%04zu.png", pose);
 
-      surfelsToSamples.use(); LOG_GL();
-      if (cameraMoved) { cam.pushTransformMatrix(); } LOG_GL();
+      writer.submit(opts.outputPrefix + suffix, width, height, rgba);
 
-      surfels.render(surfelsToSamplesSizes[0], surfelsToSamplesSizes[1]); LOG_GL();
+      return true;
+   };
 
-      //Block until all image ops in the previous shader are done
-      //(more or less).
-      glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+   framePacer::clock::time_point start = framePacer::clock::now();
 
-      samplesToPixels.use(); LOG_GL();
+   for (size_t i = 0; i < numPoses; ++i)
+   {
+      pipeline.getCamera().setPose(path.getPose(i));
+      pipeline.updateCamera();
 
-      //TODO check workgroup maximums
-      uint32_t xWkgps, yWkgps;
-      
-      getWkgpDimensions(xWkgps, yWkgps,
-			samplesToPixelsSizes[0], samplesToPixelsSizes[1],
-			winX, winY);
+      for (GLuint j = 0; j < framesPerPose; ++j)
+      {
+	 profiler.beginFrame();
 
-      glDispatchCompute(xWkgps,
-			yWkgps,
-			1);
+	 pipeline.draw(profiler);
 
-      LOG_GL();
+	 //The last frame's the one to keep
+	 if (j + 1 == framesPerPose)
+	 {
+	    //No room for another: the oldest has to come out first
+	    if (readback.full()) { writeOldest(true); }
 
-      glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+	    profiler.begin(passReadback);
+	    readback.read(pipeline.getPixels(), frame, i);
+	    profiler.end(passReadback);
+	 }
 
-      pixels.blit(frame);
+	 profiler.begin(passClear);
+	 pipeline.clear();
+	 profiler.end(passClear);
 
-      glFlush(); //Executes any lazy command buffers
-      glFinish(); //Blocks til they're done
+	 profiler.endFrame();
+      }
 
-      instance.swapWindow(); LOG_GL();
+      //Whatever else is ready, without waiting
+      while (writeOldest(false)) {}
 
-      //Clear for next frame
-      samples.clear();
-      pixels.clear();
+      profiler.report(2.0);
+   }
 
-      LOG_GL();
-      
-      glClear(GL_COLOR_BUFFER_BIT); LOG_GL();
+   while (writeOldest(true)) {}
+
+   //Rendering's done; the writers may not be
+   double renderSeconds = chrono::duration<double>(framePacer::clock::now() - start).count();
+
+   bool written = writer.finish();
+
+   double seconds = chrono::duration<double>(framePacer::clock::now() - start).count();
+
+   //Drawn, that is, by every view of every frame
+   double points = ((double) pipeline.getNumSurfels() * (double) opts.numViews *
+		    (double) framesPerPose * (double) numPoses);
+
+   cout << "Wrote " << numPoses << " frame(s) to " << opts.outputPrefix << "-*.png in "
+	<< seconds << "s (rendered in " << renderSeconds << "s): "
+	<< (double) numPoses / seconds << " frames/s, "
+	<< points / seconds / 1.0e6 << "M points/s" << endl;
+
+   cout << "Waited " << readback.getWaitSeconds() << "s for the GPU, "
+	<< writer.getStalledSeconds() << "s for " << numWriters << " writer thread(s)" << endl;
+
+   printErrorsGL();
+
+   return written ? 0 : 1;
+}
+
+/*
+  Pixels either side of a poster's tile that are drawn but not kept,
+  so what's near the edge of a tile comes out as it would away from
+  one: splats reaching in from outside it, holes filled from both
+  sides, the resolve filter's overlap.
+*/
+int
+getPosterMargin(const options& opts)
+{
+   int samples = 2;
+
+   if (opts.splat) { samples += (int) opts.maxSplatRadius; }
+   if (opts.fillLevels) { samples += 1 << opts.fillLevels; }
+
+   int supersample = (int) opts.supersample;
+
+   return (samples + supersample - 1) / supersample;
+}
+
+/*
+  Renders one image of any size, in tiles no bigger than the GL can
+  render (or than --size), streaming each to the file as it's done -
+  so memory is a tile's worth, however big the poster. Each tile is a
+  window of the camera's image (see frustum::setWindow()), drawn with
+  a margin around it and cropped. With --cull, each tile also culls
+  the clusters outside it.
+*/
+int
+runPoster(const options& opts)
+{
+   eglInstance context;
+
+   prepDebugOutputGL();
+
+   int supersample = (int) opts.supersample;
+   int maxSide = getDeviceCapabilities().maxTextureSize / supersample;
+
+   /*
+     Tiles start at multiples of align pixels, and the margin's a
+     multiple too. Even, so the samples image's halves are exact (see
+     surfelsToSamples' getWindowCoords()); with hole filling, so the
+     pyramid's texels line up as they would over the whole image.
+   */
+   int align = opts.fillLevels ? (1 << opts.fillLevels) : 2;
+
+   int margin = (getPosterMargin(opts) + align - 1) / align * align;
+
+   int tileX = (min(opts.width, maxSide) - 2 * margin) / align * align;
+   int tileY = (min(opts.height, maxSide) - 2 * margin) / align * align;
+
+   if ((tileX < 1) || (tileY < 1))
+   {
+      throw runtime_error("--size is too small for tiles with a margin of " +
+			  to_string(margin) + " pixels");
+   }
+
+   int renderX = tileX + 2 * margin;
+   int renderY = tileY + 2 * margin;
+
+   renderer pipeline(opts, renderX, renderY);
+
+   //Read back through
+   framebuffer frame; LOG_GL();
+
+   frame.prep(pipeline.getPixels()); LOG_GL();
+
+   printProgramCacheStats();
+
+   camera& cam = pipeline.getCamera();
+
+   if (opts.poseFileName.size())
+   {
+      cameraPath path;
+
+      path.load(opts.poseFileName);
+
+      cam.setPose(path.getPose(0));
+   }
+
+   int width = opts.posterWidth;
+   int height = opts.posterHeight;
+
+   //The poster's shape, not a tile's
+   cam.setAspectRatio((float) width / (float) height);
+
+   string fileName = opts.outputPrefix + ".ppm";
+
+   posterFile poster(fileName, width, height);
+
+   gpuProfiler profiler(profiledPassNames, opts.profile, opts.profileFileName);
+
+   //With temporal accumulation, each tile takes the frames to settle
+   GLuint framesPerTile = pipeline.getFramesToSettle();
+
+   int columns = (width + tileX - 1) / tileX;
+   int rows = (height + tileY - 1) / tileY;
+
+   vector<uint8_t> rgba;
+
+   framePacer::clock::time_point start = framePacer::clock::now();
+
+   //From the top left, as the file goes
+   for (int row = 0; row < rows; ++row)
+   {
+      for (int column = 0; column < columns; ++column)
+      {
+	 int x = column * tileX;
+	 int y = row * tileY;
+
+	 //What's drawn, margin and all, in pixels from the bottom left
+	 //of the poster, as NDC go
+	 double left = (double) (x - margin);
+	 double bottom = (double) (height - y - tileY - margin);
+
+	 cam.setWindow((float) (2.0 * left / width - 1.0),
+		       (float) (2.0 * bottom / height - 1.0),
+		       (float) (2.0 * (left + renderX) / width - 1.0),
+		       (float) (2.0 * (bottom + renderY) / height - 1.0));
+
+	 pipeline.updateCamera();
+
+	 for (GLuint i = 0; i < framesPerTile; ++i)
+	 {
+	    profiler.beginFrame();
+
+	    pipeline.draw(profiler);
+
+	    //The last frame's the one to keep
+	    if (i + 1 == framesPerTile)
+	    {
+	       profiler.begin(passReadback);
+	       pipeline.getPixels().read(frame, rgba);
+	       profiler.end(passReadback);
+	    }
+
+	    profiler.begin(passClear);
+	    pipeline.clear();
+	    profiler.end(passClear);
+
+	    profiler.endFrame();
+	 }
+
+	 //Tiles on the right and bottom edges may hang off the poster
+	 poster.writeTile(x, y, min(tileX, width - x), min(tileY, height - y),
+			  rgba, renderX, renderY, margin, margin);
+
+	 profiler.report(2.0);
+      }
    }
 
+   bool written = poster.close();
+
+   double seconds = chrono::duration<double>(framePacer::clock::now() - start).count();
+
+   size_t numTiles = (size_t) columns * (size_t) rows;
+
+   double points = (double) pipeline.getNumSurfels() * (double) framesPerTile * (double) numTiles;
+
+   cout << "Wrote a " << width << "x" << height << " poster to " << fileName << " in "
+	<< numTiles << " tiles of " << tileX << "x" << tileY << " (with a margin of "
+	<< margin << "), in " << seconds << "s: " << (double) numTiles / seconds
+	<< " tiles/s, " << points / seconds / 1.0e6 << "M points/s" << endl;
+
    printErrorsGL();
 
+   return written ? 0 : 1;
+}
+
+/*
+  Stands in for a sensor: sends the model, cut into sweeps as for
+  --live, to an address another run's listening on, a sweep each
+  period, til told to stop (or forever).
+*/
+int
+runSend(const options& opts)
+{
+   pcdReader pcd;
+
+   pcd.prep("resources/models/" + opts.modelFileName);
+
+   vector<float> feed = pcd.read();
+
+   size_t numSurfels = feed.size() / 4;
+   size_t numSweeps = opts.liveSweeps ? opts.liveSweeps : 1;
+   size_t sweepSurfels = (numSurfels + numSweeps - 1) / numSweeps;
+
+   sweepSender sender(opts.sendAddress);
+
+   cout << "Sending " << opts.modelFileName << " to " << opts.sendAddress << " as "
+	<< numSweeps << " sweep(s) of " << sweepSurfels << " surfels, " << opts.liveRate
+	<< " a second" << endl;
+
+   typedef chrono::steady_clock clock;
+
+   clock::time_point start = clock::now();
+
+   size_t numSent = 0;
+
+   while ((!opts.numFrames || (numSent < opts.numFrames)) &&
+	  ((opts.numSeconds == 0.f) ||
+	   (chrono::duration<double>(clock::now() - start).count() < opts.numSeconds)))
+   {
+      size_t first = (numSent % numSweeps) * sweepSurfels;
+      size_t count = (first < numSurfels) ? min(sweepSurfels, numSurfels - first) : 0;
+
+      sender.send(feed.data() + first * 4, count, 1.0 / opts.liveRate);
+
+      ++numSent;
+   }
+
+   double seconds = chrono::duration<double>(clock::now() - start).count();
+
+   cout << "Sent " << numSent << " sweep(s) in " << seconds << "s, in " << sender.getNumSent()
+	<< " packet(s); " << sender.getNumFailed() << " couldn't be sent" << endl;
+
    return 0;
 }
+
+int
+main(int argc, char** args)
+{
+   SDL_SetMainReady();
+
+   options opts;
+
+   try
+   {
+      opts = parseOptions(argc, args);
+   }
+
+   catch (const exception& err)
+   {
+      cerr << err.what() << endl;
+
+      printUsage(args[0]);
+
+      return 1;
+   }
+
+   if (opts.programCache) { programCacheDir = programCacheDirectory; }
+
+   //Failing to make a context, or to load the model
+   try
+   {
+      if (opts.sendAddress.size()) { return runSend(opts); }
+
+      if (opts.batchFileName.size()) { return runBatch(opts); }
+
+      if (opts.posterWidth) { return runPoster(opts); }
+
+      return opts.headless ? runHeadless(opts) : runWindowed(opts);
+   }
+
+   catch (const exception& err)
+   {
+      cerr << err.what() << endl;
+
+      return 1;
+   }
+}
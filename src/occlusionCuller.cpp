@@ -0,0 +1,155 @@
+#include "../lib/glad/include/glad/glad.h"
+
+#include "occlusionCuller.hpp"
+
+//Shader bindings and locations; see cullClusters.c.glsl
+static const GLuint clustersBinding = 4;
+static const GLuint candidatesBinding = 5;
+static const GLuint visibleBinding = 6;
+static const GLuint deferredBinding = 7;
+
+static const GLuint hiZUnit = 0;
+
+static const GLint perspectiveLoc = 0;
+static const GLint samplesXYLoc = 1;
+static const GLint numClustersLoc = 2;
+static const GLint phaseLoc = 3;
+static const GLint hiZLevelsLoc = 4;
+static const GLint maxGroupsXLoc = 8;
+
+//Which of lists[] is which
+static const GLuint deferredList = 2;
+
+//Each list starts with a dispatch size and a count (see the shader)
+static const size_t listHeaderBytes = 4 * sizeof(GLuint);
+
+//Enough to get down to 1x1 from any size of samples image there'll be
+static const GLuint hiZMaxLevels = 16;
+
+occlusionCuller::occlusionCuller()
+   : test ("resources/shaders/cullClusters.c.glsl")
+   , finalize ("resources/shaders/cullClusters.c.glsl", {{"FINALIZE", "1"}})
+   , build ("resources/shaders/buildHiZ.c.glsl")
+   , hiZ (hiZMaxLevels)
+   , numClusters (0)
+   , maxGroupsX (0)
+   , hiZValid (false)
+{
+   glGetProgramiv(test.getHandle(), GL_COMPUTE_WORK_GROUP_SIZE, cullSizes);
+   glGetProgramiv(build.getHandle(), GL_COMPUTE_WORK_GROUP_SIZE, buildSizes);
+
+   maxGroupsX = getDeviceCapabilities().maxWkgpCount[0];
+}
+
+void occlusionCuller::prep(const surfelModel& model, GLuint samplesX, GLuint samplesY)
+{
+   const std::vector<float>& bounds = model.getClusterBounds();
+
+   //Two vec4s per cluster
+   numClusters = bounds.size() / 8;
+
+   clusters.prep(bounds, clustersBinding);
+
+   for (buffer& list : lists)
+   {
+      list.prep(listHeaderBytes + numClusters * sizeof(GLuint), visibleBinding);
+   }
+
+   hiZ.prep(samplesX, samplesY);
+
+   LOG_GL();
+}
+
+void occlusionCuller::resize(GLuint width, GLuint height)
+{
+   hiZ.resize(width, height);
+
+   hiZValid = false;
+}
+
+void occlusionCuller::cull(GLuint phase, const geom::mat4& transform, image& samples)
+{
+   buffer& visible = lists[phase];
+   buffer& deferred = lists[deferredList];
+
+   //Reset counts (and dispatch sizes)
+   visible.clear(0, listHeaderBytes);
+
+   if (!phase) { deferred.clear(0, listHeaderBytes); }
+
+   glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+
+   test.use();
+
+   GLuint samplesX, samplesY;
+   samples.getSize(samplesX, samplesY);
+
+   glUniformMatrix4fv(perspectiveLoc, 1, false, (GLfloat*) &transform);
+   glUniform2ui(samplesXYLoc, samplesX, samplesY);
+   glUniform1ui(numClustersLoc, numClusters);
+   glUniform1i(phaseLoc, (GLint) phase);
+   glUniform1ui(hiZLevelsLoc, hiZValid ? hiZ.getNumLevels() : 0);
+
+   clusters.bind(clustersBinding);
+   visible.bind(visibleBinding);
+   deferred.bind(phase ? candidatesBinding : deferredBinding);
+
+   hiZ.bindTexture(hiZUnit);
+
+   if (!phase)
+   {
+      uint32_t xWkgps, yWkgps;
+
+      getWkgpDimensions(xWkgps, yWkgps,
+			cullSizes[0], cullSizes[1],
+			numClusters, 1);
+
+      glDispatchCompute(xWkgps, yWkgps, 1);
+   }
+
+   else
+   {
+      //Phase 1 left the size of this in the deferred list
+      glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, deferred.getHandle());
+      glDispatchComputeIndirect(0);
+   }
+
+   glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+   //Turn counts into dispatch sizes
+   finalize.use();
+
+   glUniform1i(phaseLoc, (GLint) phase);
+   glUniform1ui(maxGroupsXLoc, (GLuint) maxGroupsX);
+
+   visible.bind(visibleBinding);
+   if (!phase) { deferred.bind(deferredBinding); }
+
+   glDispatchCompute(1, 1, 1);
+
+   glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+
+   LOG_GL();
+}
+
+void occlusionCuller::draw(GLuint phase)
+{
+   //surfelsToSamples reads its list at the candidates binding
+   lists[phase].bind(candidatesBinding);
+
+   glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, lists[phase].getHandle());
+   glDispatchComputeIndirect(0);
+
+   LOG_GL();
+}
+
+void occlusionCuller::updateHiZ(image& samples)
+{
+   build.use();
+
+   hiZ.reduce(samples, buildSizes);
+
+   glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+
+   hiZValid = true;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "compute.hpp"
+
+class occlusionCuller
+/*
+  Hierarchical-Z occlusion culling of surfel clusters, done on the GPU
+  in two phases a frame:
+
+  1. Test every cluster against a pyramid of the furthest depths in
+     the last frame's samples. Draw those visible; defer those hidden.
+  2. Rebuild the pyramid from what phase 1 drew, then test the
+     deferred clusters against it and draw any that are visible now
+     (i.e. uncovered since the last frame).
+
+  After phase 2 the pyramid is rebuilt again, for the next frame.
+  Clusters come from surfelModel::prep(), given clusterSize.
+*/
+{
+public:
+   //Surfels per cluster. Also the CLUSTER_SIZE of surfelsToSamples.
+   static const GLuint clusterSize = 256;
+
+private:
+   program test;
+   program finalize;
+   program build;
+
+   pyramid hiZ;
+
+   buffer clusters;
+
+   //Visible in phase 1, visible in phase 2, deferred in phase 1
+   buffer lists[3];
+
+   GLuint numClusters;
+
+   int cullSizes[3];
+   int buildSizes[3];
+
+   GLint maxGroupsX;
+
+   //Whether the pyramid matches the samples image; not before the
+   //first frame, or after a resize.
+   bool hiZValid;
+
+public:
+   occlusionCuller();
+
+   void prep(const surfelModel& model, GLuint samplesX, GLuint samplesY);
+
+   void resize(GLuint width, GLuint height);
+
+   //Fill the list of visible clusters for a phase (0 or 1).
+   //NB changes the program in use.
+   void cull(GLuint phase, const geom::mat4& transform, image& samples);
+
+   //Draw the clusters cull() found for a phase. surfelsToSamples
+   //(built with CLUSTER_SIZE) must be in use.
+   void draw(GLuint phase);
+
+   //Rebuild the pyramid from the samples drawn so far
+   //NB changes the program in use.
+   void updateHiZ(image& samples);
+};
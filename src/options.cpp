@@ -0,0 +1,659 @@
+#include "options.hpp"
+
+#include <cmath>
+#include <iostream>
+#include <stdexcept>
+
+using namespace std;
+
+options::options()
+   : modelFileName ("ism_train_horse.pcd")
+   , liveSweeps (0)
+   , liveRate (20.f)
+   , maxSweepSurfels (262144)
+   , supersample (2.f)
+   , filter (resolveFilter::box)
+   , temporalGrid (0)
+   , fillLevels (0)
+   , splat (false)
+   , splatRadius (1.f)
+   , maxSplatRadius (4)
+   , cull (false)
+   , numViews (1)
+   , tune (true)
+   , retune (false)
+   , programCache (true)
+   , framesInFlight (2)
+   , frameStats (false)
+   , profile (false)
+   , targetFrameMs (0.f)
+   , minScale (0.5f)
+   , directPresent (false)
+   , width (960)
+   , height (540)
+   , headless (false)
+   , outputPrefix ("build/frame")
+   , numFrames (0)
+   , numSeconds (0.f)
+   , benchmark (false)
+   , captureFps (60)
+   , posterWidth (0)
+   , posterHeight (0)
+{}
+
+namespace
+{
+   //Get the value following an option, e.g. the '2' in '-s 2'.
+   string takeValue(int argc, char** args, int& i)
+   {
+      if (i + 1 >= argc)
+      {
+	 throw invalid_argument(string("No value given for option ") + args[i]);
+      }
+
+      return string(args[++i]);
+   }
+
+   float toFloat(const string& option, const string& value)
+   {
+      size_t used = 0;
+      float result = 0.f;
+
+      try { result = stof(value, &used); }
+
+      catch (const exception&) { used = 0; }
+
+      if (!used || (used != value.size()))
+      {
+	 throw invalid_argument("Value \"" + value + "\" given for " + option +
+				" is not a number");
+      }
+
+      return result;
+   }
+
+   //<width>x<height>, each a whole number from 1 to maxSide
+   void toSize(const string& option, const string& value, float maxSide,
+	       int& width, int& height)
+   {
+      size_t x = value.find('x');
+
+      if (x == string::npos)
+      {
+	 throw invalid_argument("Size must be given as <width>x<height>");
+      }
+
+      float w = toFloat(option, value.substr(0, x));
+      float h = toFloat(option, value.substr(x + 1));
+
+      if ((w < 1.f) || (h < 1.f) || (w > maxSide) || (h > maxSide) ||
+	  (w != floor(w)) || (h != floor(h)))
+      {
+	 throw invalid_argument("Width and height must be whole numbers from 1 to " +
+				to_string((int) maxSide));
+      }
+
+      width = (int) w;
+      height = (int) h;
+   }
+}
+
+options parseOptions(int argc, char** args)
+{
+   options opts;
+
+   bool filterGiven = false;
+   bool supersampleGiven = false;
+
+   for (int i = 1; i < argc; ++i)
+   {
+      string arg = args[i];
+
+      if ((arg == "-s") || (arg == "--supersample"))
+      {
+	 opts.supersample = toFloat(arg, takeValue(argc, args, i));
+
+	 //Much above 4x the samples image gets unreasonably big (and
+	 //the resolve unreasonably slow) for a window of any size.
+	 if ((opts.supersample < 1.f) || (opts.supersample > 4.f))
+	 {
+	    throw invalid_argument("Supersampling factor must be between 1 and 4");
+	 }
+
+	 supersampleGiven = true;
+      }
+
+      else if ((arg == "-f") || (arg == "--filter"))
+      {
+	 string value = takeValue(argc, args, i);
+
+	 if (value == "none") { opts.filter = resolveFilter::none; }
+	 else if (value == "box") { opts.filter = resolveFilter::box; }
+	 else if (value == "tent") { opts.filter = resolveFilter::tent; }
+
+	 else { throw invalid_argument("Unknown resolve filter \"" + value + "\""); }
+
+	 filterGiven = true;
+      }
+
+      else if (arg == "--temporal")
+      {
+	 float grid = toFloat(arg, takeValue(argc, args, i));
+
+	 //As with -s, past 4 (here, 16 frames) there's little to gain;
+	 //8 is 64 frames before the picture's settled.
+	 if ((grid < 0.f) || (grid == 1.f) || (grid > 8.f) || (grid != floor(grid)))
+	 {
+	    throw invalid_argument("Temporal grid must be 0 (off) or a whole number from 2 to 8");
+	 }
+
+	 opts.temporalGrid = (unsigned int) grid;
+      }
+
+      else if (arg == "--fill-holes")
+      {
+	 string value = takeValue(argc, args, i);
+
+	 float levels = toFloat(arg, value);
+
+	 //Past 8 levels a 'hole' is 256 samples wide; that's no longer
+	 //filling gaps so much as making things up.
+	 if ((levels < 0.f) || (levels > 8.f) || (levels != floor(levels)))
+	 {
+	    throw invalid_argument("Hole filling levels must be a whole number from 0 to 8");
+	 }
+
+	 opts.fillLevels = (unsigned int) levels;
+      }
+
+      else if (arg == "--splat") { opts.splat = true; }
+
+      else if (arg == "--splat-radius")
+      {
+	 opts.splatRadius = toFloat(arg, takeValue(argc, args, i));
+
+	 if (opts.splatRadius < 0.f)
+	 {
+	    throw invalid_argument("Splat radius can't be negative");
+	 }
+
+	 opts.splat = true;
+      }
+
+      else if (arg == "--splat-max")
+      {
+	 float reach = toFloat(arg, takeValue(argc, args, i));
+
+	 //The loop over a splat is (2r + 1)^2 atomics
+	 if ((reach < 0.f) || (reach > 16.f) || (reach != floor(reach)))
+	 {
+	    throw invalid_argument("Maximum splat radius must be a whole number from 0 to 16");
+	 }
+
+	 opts.maxSplatRadius = (unsigned int) reach;
+      }
+
+      else if (arg == "--cull") { opts.cull = true; }
+
+      else if (arg == "--views")
+      {
+	 float views = toFloat(arg, takeValue(argc, args, i));
+
+	 //They share the frame's width; past 8, at the default size,
+	 //they're slivers.
+	 if ((views < 1.f) || (views > 8.f) || (views != floor(views)))
+	 {
+	    throw invalid_argument("Views must be a whole number from 1 to 8");
+	 }
+
+	 opts.numViews = (unsigned int) views;
+      }
+
+      else if (arg == "--scene") { opts.sceneFileName = takeValue(argc, args, i); }
+
+      else if (arg == "--live")
+      {
+	 float sweeps = toFloat(arg, takeValue(argc, args, i));
+
+	 if ((sweeps < 1.f) || (sweeps > 256.f) || (sweeps != floor(sweeps)))
+	 {
+	    throw invalid_argument("Live sweeps must be a whole number from 1 to 256");
+	 }
+
+	 opts.liveSweeps = (unsigned int) sweeps;
+      }
+
+      else if (arg == "--live-hz")
+      {
+	 opts.liveRate = toFloat(arg, takeValue(argc, args, i));
+
+	 if ((opts.liveRate <= 0.f) || (opts.liveRate > 1000.f))
+	 {
+	    throw invalid_argument("Live sweep rate must be over 0, up to 1000Hz");
+	 }
+      }
+
+      else if (arg == "--listen") { opts.listenAddress = takeValue(argc, args, i); }
+
+      else if (arg == "--sweep-max")
+      {
+	 float points = toFloat(arg, takeValue(argc, args, i));
+
+	 //What a sweep's index in the packets can reach, near enough
+	 if ((points < 1.f) || (points > 16777216.f) || (points != floor(points)))
+	 {
+	    throw invalid_argument("Points a sweep must be a whole number from 1 to 16777216");
+	 }
+
+	 opts.maxSweepSurfels = (unsigned int) points;
+      }
+
+      else if (arg == "--send") { opts.sendAddress = takeValue(argc, args, i); }
+
+      else if (arg == "--no-tune") { opts.tune = false; }
+
+      else if (arg == "--retune") { opts.retune = true; }
+
+      else if (arg == "--no-program-cache") { opts.programCache = false; }
+
+      else if (arg == "--frames-in-flight")
+      {
+	 float frames = toFloat(arg, takeValue(argc, args, i));
+
+	 //Past a few, it's just latency
+	 if ((frames < 1.f) || (frames > 4.f) || (frames != floor(frames)))
+	 {
+	    throw invalid_argument("Frames in flight must be a whole number from 1 to 4");
+	 }
+
+	 opts.framesInFlight = (unsigned int) frames;
+      }
+
+      else if (arg == "--frame-stats") { opts.frameStats = true; }
+
+      else if (arg == "--profile") { opts.profile = true; }
+
+      else if (arg == "--profile-csv")
+      {
+	 opts.profileFileName = takeValue(argc, args, i);
+	 opts.profile = true;
+      }
+
+      else if (arg == "--target-ms")
+      {
+	 opts.targetFrameMs = toFloat(arg, takeValue(argc, args, i));
+
+	 if ((opts.targetFrameMs < 0.f) || (opts.targetFrameMs > 1000.f))
+	 {
+	    throw invalid_argument("Target frame time must be from 0 to 1000ms");
+	 }
+      }
+
+      else if (arg == "--min-scale")
+      {
+	 opts.minScale = toFloat(arg, takeValue(argc, args, i));
+
+	 //Much below a quarter, there's not much of a picture left
+	 if ((opts.minScale < 0.25f) || (opts.minScale > 1.f))
+	 {
+	    throw invalid_argument("Minimum resolution scale must be from 0.25 to 1");
+	 }
+      }
+
+      else if (arg == "--present")
+      {
+	 string value = takeValue(argc, args, i);
+
+	 if (value == "blit") { opts.directPresent = false; }
+	 else if (value == "direct") { opts.directPresent = true; }
+
+	 else { throw invalid_argument("Unknown way to present \"" + value + "\""); }
+      }
+
+      else if (arg == "--size")
+      {
+	 //Few GLs take textures over 16K a side (and the samples image
+	 //is bigger still)
+	 toSize(arg, takeValue(argc, args, i), 16384.f, opts.width, opts.height);
+      }
+
+      else if (arg == "--poster")
+      {
+	 //Tiles are written straight to the file, so the limit's only
+	 //to keep it to a file that can be opened
+	 toSize(arg, takeValue(argc, args, i), 131072.f, opts.posterWidth, opts.posterHeight);
+
+	 opts.headless = true;
+      }
+
+      else if (arg == "--pose") { opts.poseFileName = takeValue(argc, args, i); }
+
+      else if (arg == "--headless") { opts.headless = true; }
+
+      else if (arg == "--frames")
+      {
+	 float frames = toFloat(arg, takeValue(argc, args, i));
+
+	 if ((frames < 1.f) || (frames != floor(frames)))
+	 {
+	    throw invalid_argument("Number of frames must be a whole number, at least 1");
+	 }
+
+	 opts.numFrames = (unsigned int) frames;
+      }
+
+      else if (arg == "--seconds")
+      {
+	 opts.numSeconds = toFloat(arg, takeValue(argc, args, i));
+
+	 if (opts.numSeconds <= 0.f)
+	 {
+	    throw invalid_argument("Number of seconds must be more than 0");
+	 }
+      }
+
+      else if (arg == "--output") { opts.outputPrefix = takeValue(argc, args, i); }
+
+      else if (arg == "--benchmark") { opts.benchmark = true; }
+
+      else if (arg == "--benchmark-json")
+      {
+	 opts.benchmarkFileName = takeValue(argc, args, i);
+	 opts.benchmark = true;
+      }
+
+      else if (arg == "--record") { opts.recordFileName = takeValue(argc, args, i); }
+
+      else if (arg == "--replay") { opts.replayFileName = takeValue(argc, args, i); }
+
+      else if (arg == "--capture") { opts.captureFileName = takeValue(argc, args, i); }
+
+      else if (arg == "--capture-fps")
+      {
+	 float fps = toFloat(arg, takeValue(argc, args, i));
+
+	 if ((fps < 1.f) || (fps > 1000.f) || (fps != floor(fps)))
+	 {
+	    throw invalid_argument("Capture frame rate must be a whole number from 1 to 1000");
+	 }
+
+	 opts.captureFps = (unsigned int) fps;
+      }
+
+      else if (arg == "--batch")
+      {
+	 opts.batchFileName = takeValue(argc, args, i);
+	 opts.headless = true;
+      }
+
+      else if ((arg.size() > 1) && (arg[0] == '-'))
+      {
+	 throw invalid_argument("Unknown option \"" + arg + "\"");
+      }
+
+      else { opts.modelFileName = arg; }
+   }
+
+   //Averaging jittered frames does what supersampling would, so it's
+   //1x unless more was asked for.
+   if (opts.temporalGrid && !supersampleGiven) { opts.supersample = 1.f; }
+
+   //At 1x there's only one sample to a pixel, so a filter would just
+   //be wasted time - unless one was asked for.
+   if ((opts.supersample == 1.f) && !filterGiven)
+   {
+      opts.filter = resolveFilter::none;
+   }
+
+   if (opts.retune && !opts.tune)
+   {
+      throw invalid_argument("--retune and --no-tune can't be used together");
+   }
+
+   if (opts.recordFileName.size() && opts.replayFileName.size())
+   {
+      throw invalid_argument("--record and --replay can't be used together");
+   }
+
+   if (opts.recordFileName.size() && opts.headless)
+   {
+      throw invalid_argument("There's no camera to record without a window");
+   }
+
+   //Headless frames are written at the size asked for
+   if ((opts.targetFrameMs > 0.f) && opts.headless)
+   {
+      throw invalid_argument("--target-ms needs a window to scale frames up to");
+   }
+
+   if (opts.directPresent && opts.headless)
+   {
+      throw invalid_argument("--present direct needs a window to present to");
+   }
+
+   //It draws a pixel for each of the window's
+   if (opts.directPresent && (opts.targetFrameMs > 0.f))
+   {
+      throw invalid_argument("--present direct only renders at the window's size, so can't take --target-ms");
+   }
+
+   if (opts.captureFileName.size() && opts.headless)
+   {
+      throw invalid_argument("--capture records the window; headless frames are written anyway");
+   }
+
+   //It's the pixels image that's read back, and a video's frames are
+   //all one size
+   if (opts.captureFileName.size() && (opts.directPresent || (opts.targetFrameMs > 0.f)))
+   {
+      throw invalid_argument("--capture can't be used with --present direct or --target-ms");
+   }
+
+   //Nothing's drawn, so nothing else applies but what's sent
+   if (opts.sendAddress.size() &&
+       (opts.listenAddress.size() || opts.sceneFileName.size() || opts.headless ||
+	opts.batchFileName.size() || (opts.posterWidth > 0) || opts.replayFileName.size()))
+   {
+      throw invalid_argument("--send only sends a model; it can't take --listen, --scene, --headless, "
+			     "--batch, --poster or --replay");
+   }
+
+   if (opts.listenAddress.size())
+   {
+      if (opts.sceneFileName.size())
+      {
+	 throw invalid_argument("--listen draws sweeps from the socket; it can't take --scene");
+      }
+
+      //As with --live (which it implies), below
+      if (opts.temporalGrid)
+      {
+	 throw invalid_argument("--listen can't be used with --temporal");
+      }
+
+      //Whole sweeps, as a sensor's are
+      if (!opts.liveSweeps) { opts.liveSweeps = 1; }
+
+      //There's nothing to time the variants on til sweeps come in;
+      //the shaders' own sizes it is
+      opts.tune = false;
+   }
+
+   //Clusters are culled against one view's depth
+   if (opts.cull && (opts.numViews > 1))
+   {
+      throw invalid_argument("--cull only works with a single view");
+   }
+
+   //Clusters' bounds are of one model, where it was loaded
+   if (opts.cull && (opts.sceneFileName.size() || opts.liveSweeps))
+   {
+      throw invalid_argument("--cull only works with a single static model, not --scene or --live");
+   }
+
+   //Each frame draws only part of every sample, to be averaged with
+   //the frames after it; with sweeps coming in, there'd be nothing
+   //still long enough to average
+   if (opts.liveSweeps && opts.temporalGrid)
+   {
+      throw invalid_argument("--live can't be used with --temporal");
+   }
+
+   if (opts.liveSweeps && opts.sceneFileName.size())
+   {
+      throw invalid_argument("--live streams a single model; it can't take --scene");
+   }
+
+   //Both render one pose after another as fast as they can, rather
+   //than in time with a feed
+   if (opts.liveSweeps && (opts.batchFileName.size() || (opts.posterWidth > 0)))
+   {
+      throw invalid_argument("--live can't be used with --batch or --poster");
+   }
+
+   bool poster = opts.posterWidth > 0;
+
+   if (poster && (opts.batchFileName.size() || opts.replayFileName.size() || opts.benchmark))
+   {
+      throw invalid_argument("--poster can't be used with --batch, --replay or --benchmark");
+   }
+
+   if (poster && (opts.numFrames || (opts.numSeconds > 0.f)))
+   {
+      throw invalid_argument("--poster renders one image; it can't take --frames or --seconds");
+   }
+
+   if (opts.poseFileName.size() && !poster)
+   {
+      throw invalid_argument("--pose is only for --poster");
+   }
+
+   //Tiles have to meet exactly, pixel for pixel, so every pixel has
+   //to be the same whole number of samples
+   if (poster && (opts.supersample != floor(opts.supersample)))
+   {
+      throw invalid_argument("--poster needs a whole number for -s");
+   }
+
+   //Each tile would be a wall of its own
+   if (poster && (opts.numViews > 1))
+   {
+      throw invalid_argument("--poster only works with a single view");
+   }
+
+   //Batches are of frames to keep, not timings
+   if (opts.batchFileName.size() && (opts.replayFileName.size() || opts.benchmark))
+   {
+      throw invalid_argument("--batch can't be used with --replay or --benchmark");
+   }
+
+   //A path sets its own length
+   if (opts.replayFileName.size() && (opts.numFrames || (opts.numSeconds > 0.f)))
+   {
+      throw invalid_argument("--replay runs for as long as the path; it can't take --frames or --seconds");
+   }
+
+   if (opts.batchFileName.size() && (opts.numFrames || (opts.numSeconds > 0.f)))
+   {
+      throw invalid_argument("--batch renders every pose in the file; it can't take --frames or --seconds");
+   }
+
+   //Long enough for things to settle
+   if (opts.benchmark && !opts.replayFileName.size() &&
+       !opts.numFrames && (opts.numSeconds == 0.f))
+   {
+      opts.numSeconds = 10.f;
+   }
+
+   if ((opts.filter == resolveFilter::none) && (opts.supersample != 1.f))
+   {
+      throw invalid_argument("The 'none' filter only works without supersampling (-s 1)");
+   }
+
+   return opts;
+}
+
+void printUsage(const char* programName)
+{
+   cerr << "Usage: " << programName << " [options] [model.pcd]\n"
+	<< "  -s, --supersample <factor>  samples per pixel along each axis, 1-4 (default 2)\n"
+	<< "  -f, --filter <filter>       resolve filter: none (1x only), box or tent (default box)\n"
+	<< "  --temporal <grid>           instead of supersampling grid x grid (2-8), take\n"
+	<< "                              that many jittered frames and average them while\n"
+	<< "                              the camera's still (default 0: off; -s defaults\n"
+	<< "                              to 1 with it)\n"
+	<< "  --fill-holes <levels>       fill gaps between points with a pull-push pyramid\n"
+	<< "                              of this many levels, 0-8 (default 0: off)\n"
+	<< "  --splat                     splat each surfel over the samples its radius covers\n"
+	<< "  --splat-radius <radius>     world radius of surfels with none in the model\n"
+	<< "                              (default 1); implies --splat\n"
+	<< "  --splat-max <samples>       furthest a splat reaches, 0-16 (default 4)\n"
+	<< "  --cull                      skip clusters of surfels hidden behind nearer ones\n"
+	<< "  --views <n>                 draw n cameras in one pass, side by side, each\n"
+	<< "                              turned to carry on from the last (a wall of n\n"
+	<< "                              monitors), 1-8 (default 1); not with --cull\n"
+	<< "  --scene <file>              draw many models, each placed in the world as\n"
+	<< "                              listed in the file, in place of model.pcd; not\n"
+	<< "                              with --cull\n"
+	<< "  --live <sweeps>             stream the model in, as from a sensor: cut into\n"
+	<< "                              this many sweeps (1-256), each replacing the\n"
+	<< "                              oldest as it comes in; not with --scene, --cull\n"
+	<< "                              or --temporal\n"
+	<< "  --live-hz <rate>            sweeps a second with --live (default 20; every\n"
+	<< "                              frame, headless)\n"
+	<< "  --listen <address>          draw live sweeps sent to udp:[host:]port (on\n"
+	<< "                              127.0.0.1 without a host) or unix:path, rather than\n"
+	<< "                              the model; with --live, how many are kept (default\n"
+	<< "                              1); implies --no-tune; not with --scene, --cull\n"
+	<< "                              or --temporal\n"
+	<< "  --sweep-max <points>        most points a sweep from --listen can have\n"
+	<< "                              (default 262144)\n"
+	<< "  --send <address>            draw nothing, but send the model to a --listen\n"
+	<< "                              address, cut into --live sweeps (default 1) sent at\n"
+	<< "                              --live-hz, til --frames sweeps or --seconds\n"
+	<< "  --no-tune                   use the shaders' own workgroup sizes, rather than\n"
+	<< "                              timing variants to find the GPU's fastest\n"
+	<< "  --retune                    time the variants again, even if already cached\n"
+	<< "  --no-program-cache          always compile shaders, rather than loading the\n"
+	<< "                              binaries saved by earlier runs\n"
+	<< "  --frames-in-flight <n>      frames the CPU can queue ahead of the GPU, 1-4\n"
+	<< "                              (default 2)\n"
+	<< "  --frame-stats               print throughput and latency every 2 seconds\n"
+	<< "  --profile                   print GPU times of each pass every 2 seconds\n"
+	<< "  --profile-csv <file>        also write every frame's times to a CSV file;\n"
+	<< "                              implies --profile\n"
+	<< "  --target-ms <ms>            render at lower resolution (scaled up to the\n"
+	<< "                              window) while GPU frames take longer than this\n"
+	<< "                              (default 0: always full resolution)\n"
+	<< "  --min-scale <fraction>      lowest resolution --target-ms goes to, as a\n"
+	<< "                              fraction of the window's, 0.25-1 (default 0.5)\n"
+	<< "  --present <blit|direct>     blit the frame to the window, or resolve it\n"
+	<< "                              straight into the window (default blit)\n"
+	<< "  --size <width>x<height>     size of the window or frames (default 960x540)\n"
+	<< "  --headless                  render without a window, writing frames to files\n"
+	<< "  --output <prefix>           headless frames go to <prefix>-0000.ppm, etc.\n"
+	<< "                              (default build/frame)\n"
+	<< "  --frames <n>                quit after this many frames (headless, default 1)\n"
+	<< "  --seconds <s>               quit after this many seconds\n"
+	<< "  --record <file>             save the camera's path, frame by frame\n"
+	<< "  --replay <file>             follow a saved path with vsync off, then print\n"
+	<< "                              frame times and throughput; headless, renders\n"
+	<< "                              a frame per pose\n"
+	<< "  --capture <file>            record the window to a video: Y4M if the name ends\n"
+	<< "                              in .y4m, raw RGB24 frames otherwise\n"
+	<< "  --capture-fps <n>           frame rate given in the video (default 60)\n"
+	<< "  --batch <file>              render a frame per pose in a saved path as fast\n"
+	<< "                              as possible, headless, writing them as PNGs\n"
+	<< "                              (to <prefix>-0000.png etc., as for --output)\n"
+	<< "  --poster <width>x<height>   render one image of any size, headless, in tiles\n"
+	<< "                              of --size, written to <prefix>.ppm\n"
+	<< "  --pose <file>               where the camera is for --poster: the first pose\n"
+	<< "                              in a saved path (default the starting view)\n"
+	<< "  --benchmark                 run with vsync off (for 10 seconds, unless given\n"
+	<< "                              --frames or --seconds), then print frame, CPU\n"
+	<< "                              submit and GPU execute times; headless, frames\n"
+	<< "                              aren't read back or written\n"
+	<< "  --benchmark-json <file>     also write the results as JSON; implies\n"
+	<< "                              --benchmark\n"
+	<< flush;
+}
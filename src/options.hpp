@@ -0,0 +1,144 @@
+#pragma once
+
+#include <string>
+
+//How pixels are made out of the samples that fall inside them. None
+//is only usable at 1x, where there's exactly one sample per pixel.
+enum class resolveFilter
+{
+   none,
+   box,
+   tent
+};
+
+//Settings given on the command line.
+struct options
+{
+   std::string modelFileName;
+
+   //Many models, placed about the world, in place of the one above
+   //(see surfelScene)
+   std::string sceneFileName;
+
+   //Stream the model in as a live feed of sweeps (see liveSurfels):
+   //cut into liveSweeps parts, the last liveSweeps of them drawn, a
+   //new one coming in liveRate times a second (every frame,
+   //headless). 0 for a static model.
+   unsigned int liveSweeps;
+   float liveRate;
+
+   //Live sweeps from a sensor, in place of the model's: listening on
+   //a socket (see sweepReceiver) for them, each of up to
+   //maxSweepSurfels. The last liveSweeps of them are drawn.
+   std::string listenAddress;
+   unsigned int maxSweepSurfels;
+
+   //Rather than drawing anything, send the model to a socket, cut as
+   //for liveSweeps, a sweep at a time liveRate times a second: a
+   //stand-in for a sensor, to listen to.
+   std::string sendAddress;
+
+   //Samples per pixel, along each axis. Needn't be an integer.
+   float supersample;
+   resolveFilter filter;
+
+   //Temporal accumulation: what temporalGrid x temporalGrid
+   //supersampling would give, from that many frames at 1x, each
+   //jittered by part of a sample. 0 turns it off.
+   unsigned int temporalGrid;
+
+   //Levels of pull-push hole filling; 0 turns it off.
+   unsigned int fillLevels;
+
+   //Splat surfels over as many samples as their radius covers, rather
+   //than to just one. Surfels without a radius in the model get
+   //splatRadius (in world units).
+   bool splat;
+   float splatRadius;
+   //Furthest a splat reaches from its centre, in samples
+   unsigned int maxSplatRadius;
+
+   //Hierarchical-Z occlusion culling of clusters of surfels
+   bool cull;
+
+   //Cameras drawn in each pass, side by side in the frame: the main
+   //one's view, with as many again either side, turned so their edges
+   //meet (as for a wall of monitors). 1 is the usual single view.
+   unsigned int numViews;
+
+   //Time variants of the shaders at startup to pick their workgroup
+   //sizes (unless there's a choice cached for this GPU already);
+   //retune ignores the cache.
+   bool tune;
+   bool retune;
+
+   //Keep linked programs' binaries, to skip compiling next time
+   bool programCache;
+
+   //How far the CPU can get ahead of the GPU, in frames
+   unsigned int framesInFlight;
+   //Print throughput and latency every couple of seconds
+   bool frameStats;
+
+   //Time each pass on the GPU, printing stats every couple of seconds
+   //and (with a file name) every frame's times as CSV
+   bool profile;
+   std::string profileFileName;
+
+   //Render at a fraction (at least minScale) of the window's size,
+   //picked to hold the GPU's time per frame near targetFrameMs; 0 for
+   //always full size
+   float targetFrameMs;
+   float minScale;
+
+   //Resolve straight into the window (see renderer::present()),
+   //rather than into an image that's then blitted there
+   bool directPresent;
+
+   //Size of the window, or of headless frames
+   int width, height;
+
+   //Render without a window (see eglInstance), writing frames to
+   //outputPrefix-0000.ppm etc.
+   bool headless;
+   std::string outputPrefix;
+
+   //Stop after this many frames or seconds; 0 for no limit (or, for
+   //frames headless, 1)
+   unsigned int numFrames;
+   float numSeconds;
+
+   //Vsync off, timing every frame (see benchmark), with the results
+   //printed and optionally written as JSON
+   bool benchmark;
+   std::string benchmarkFileName;
+
+   //Save the camera's pose every frame, or drive the camera from
+   //poses saved before - with vsync off, timing every frame
+   std::string recordFileName;
+   std::string replayFileName;
+
+   //Record the window to a video file as it's shown, at captureFps:
+   //Y4M if the name ends in .y4m, raw RGB24 frames otherwise (see
+   //videoWriter)
+   std::string captureFileName;
+   unsigned int captureFps;
+
+   //Render a frame per pose saved in the file (as by --record),
+   //headless, writing them as PNGs (see runBatch())
+   std::string batchFileName;
+
+   //Render one image this big, headless, in tiles of width x height,
+   //from the first pose in poseFileName (or the start, with none);
+   //posterWidth is 0 otherwise (see runPoster())
+   int posterWidth, posterHeight;
+   std::string poseFileName;
+
+   options();
+};
+
+//Throws invalid_argument if an option isn't recognised or its value
+//is bad.
+options parseOptions(int argc, char** args);
+
+void printUsage(const char* programName);
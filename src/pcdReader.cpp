@@ -115,11 +115,44 @@ bool pcdReader::seekWord(string str)
    return true;
 }
 
+void pcdReader::readFields()
+{
+   //Without a FIELDS line, assume the columns are just xyz
+   fields = { "x", "y", "z" };
+
+   if (!seekWord("FIELDS")) { return; }
+
+   fields.clear();
+
+   //seekWord() leaves the first field in word. NB COUNTs other than 1
+   //(i.e. multi-column fields) aren't supported.
+   fields.push_back(word);
+
+   string field;
+
+   while (line >> field)
+   {
+      fields.push_back(field);
+   }
+}
+
+int pcdReader::getFieldIndex(const string& name) const
+{
+   for (size_t i = 0; i < fields.size(); ++i)
+   {
+      if (fields[i] == name) { return (int) i; }
+   }
+
+   return -1;
+}
+
 size_t pcdReader::readHeader()
 {
    //Optional TODO actually check types, etc.
    //Not particularly useful at the moment.
 
+   readFields();
+
    if (!seekWord("POINTS")) { throw invalid_argument("Invalid .pcd file: no 'POINTS' section"); }
 
    if (!word.size()) { throw invalid_argument("No surfels in .pcd file"); }
@@ -130,8 +163,7 @@ size_t pcdReader::readHeader()
 
    seekWord("DATA");
 
-   //Eat 'ascii', move onto next line
-   getWord();
+   //That ate 'ascii'; the body starts on the next line.
    
    return numSurfels;
 }
@@ -142,19 +174,41 @@ vector<float> pcdReader::readBody(size_t numSurfels)
 
    result.reserve(numSurfels * 4);
 
-   const int numFields = 3; //xyz
+   //Which columns hold x, y, z and radius
+   const int numFields = 4;
+
+   const int columns[numFields] = { getFieldIndex("x"),
+				    getFieldIndex("y"),
+				    getFieldIndex("z"),
+				    getFieldIndex("radius") };
+
+   if ((columns[0] < 0) || (columns[1] < 0) || (columns[2] < 0))
+   {
+      throw invalid_argument("Invalid .pcd file: no x, y and z fields");
+   }
+
+   vector<string> row;
 
    for (int i = 0; i < (int) numSurfels; ++i)
    {
+      getLine();
+
+      row.clear();
+
+      while (line >> word) { row.push_back(word); }
+
       int j = 0;
 
       try //because stof() can throw
       {
 	 for (; j < numFields; ++j)
 	 {
-	    getWordOnLine();
+	    //No radius: leave it to the renderer's default
+	    if (columns[j] < 0) { result.push_back(0.f); continue; }
+
+	    if (columns[j] >= (int) row.size()) { throw out_of_range("Short row"); }
 
-	    float wordBinary = stof(word);
+	    float wordBinary = stof(row[columns[j]]);
 	    
 	    result.push_back(wordBinary);
 	 }
@@ -173,16 +227,7 @@ vector<float> pcdReader::readBody(size_t numSurfels)
 	 {
 	    result.pop_back();
 	 }
-
-	 //Escape from below push_back
-	 getLine();
-	 continue;
       }
-
-      //w
-      result.push_back(1.0);
-
-      getLine();
    }
 
    return move(result);
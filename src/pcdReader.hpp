@@ -14,6 +14,9 @@ private:
    istringstream line; //Buffer for line
    string word; //Buffer for a word in the line
 
+   //Names of the columns in the body, from the FIELDS line
+   vector<string> fields;
+
    const string& getWord();
    const string& getWordOnLine();
    string getLine();
@@ -24,6 +27,9 @@ private:
    void getPlace(streampos& fileSave, string& lineSave, string& wordSave);
    void setPlace(streampos fileSave, string lineSave, string wordSave);
 
+   void readFields();
+   int getFieldIndex(const string& name) const;
+
    size_t readHeader();
    vector<float> readBody(size_t numSurfels);
 
@@ -32,5 +38,7 @@ public:
    
    void prep(const string filename);
    
+   //Gives 4 floats per surfel: x, y, z and radius. The radius is 0 if
+   //the file has no 'radius' field.
    vector<float> read();
 };
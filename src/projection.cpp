@@ -81,14 +81,29 @@ frustum::getPerspectiveMatrix() const
    float zCol = 2 * nearDZ / planesDZ + 1;
    float wCol = -2.f * getFarDZ() * nearDZ / planesDZ;
 
-   geom::mat4 matrix = geom::mat4(1.f / posX, 0.f, 0.f, 0.f,
-				  0.f, 1.f / posY, 0.f, 0.f,
-				  0.f, 0.f, zCol, 1.f,
+   //w is z, so adding z * jitter to x and y moves them by jitter
+   //after the divide; likewise the window's offset. The window's scale
+   //goes on everything else.
+   geom::mat4 matrix = geom::mat4(windowScaleX / posX, 0.f, 0.f, 0.f,
+				  0.f, windowScaleY / posY, 0.f, 0.f,
+				  jitterX + windowOffsetX, jitterY + windowOffsetY, zCol, 1.f,
 				  0.f, 0.f, wCol, 0.f);
    
    return matrix;
 }
 
+geom::mat4
+frustum::getTransformMatrix() const
+{
+   return getPerspectiveMatrix() * getInverseTransformMatrix();
+}
+
+float
+frustum::getProjectionScaleY() const
+{
+   return windowScaleY / tan(verFov);
+}
+
 geom::vec3
 frustum::getPos() const
 {
@@ -107,6 +122,26 @@ frustum::getZ() const
    return dirZ;
 }
 
+cameraPose
+frustum::getPose() const
+{
+   cameraPose pose;
+
+   pose.pos = pos;
+   pose.dirZ = dirZ;
+   pose.dirY = dirY;
+
+   return pose;
+}
+
+void
+frustum::setPose(const cameraPose& pose)
+{
+   pos = pose.pos;
+   dirZ = pose.dirZ;
+   dirY = pose.dirY;
+}
+
 void
 frustum::setAspectRatio(float aspRatio)
 {
@@ -114,10 +149,46 @@ frustum::setAspectRatio(float aspRatio)
    verFov = atan(tan(horFov) / aspRatio);
 }
 
+void
+frustum::setJitter(float x, float y)
+{
+   jitterX = x;
+   jitterY = y;
+}
+
+frustum
+frustum::getWallView(unsigned int index, unsigned int numViews, float aspRatio) const
+{
+   frustum view = *this;
+
+   //Half of each view's width, as an angle
+   view.horFov = atan(tan(verFov) * aspRatio);
+
+   //From the middle of the wall to the middle of this view, each view
+   //spanning twice horFov; positive to the left
+   float angle = ((float) (numViews - 1) / 2.f - (float) index) * 2.f * view.horFov;
+
+   //Around Y, so dirY stays as it is
+   view.dirZ = dirZ * cos(angle) + getDirX() * -sin(angle);
+
+   return view;
+}
+
+void
+frustum::setWindow(float left, float bottom, float right, float top)
+{
+   windowScaleX = 2.f / (right - left);
+   windowScaleY = 2.f / (top - bottom);
+
+   //Taking the window's middle to 0
+   windowOffsetX = -(right + left) / (right - left);
+   windowOffsetY = -(top + bottom) / (top - bottom);
+}
+
 void
 camera::pushTransformMatrix()
 {
-   geom::mat4 transf = getPerspectiveMatrix() * getInverseTransformMatrix();
+   geom::mat4 transf = getTransformMatrix();
 
    glUniformMatrix4fv(transformLoc,
 		      1,
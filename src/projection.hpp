@@ -7,6 +7,14 @@
 #define GEOM_CPP
 #include "../lib/geom/geom.h"
 
+//Where a camera is and which way it faces; everything that changes
+//as it moves, but not its lens.
+struct cameraPose
+{
+   geom::vec3 pos;
+   geom::vec3 dirZ, dirY;
+};
+
 class frustum
 {
 protected:
@@ -15,6 +23,11 @@ protected:
    float horFov, verFov; //Fields of view
    float nearDZ, planesDZ; //distance from position to near plane;
 			   //from near plane to far plane
+   float jitterX, jitterY; //Offset of the image, in NDC
+   //Of the part of the image drawn (see setWindow()): NDC of the
+   //whole image to NDC of the part
+   float windowScaleX, windowScaleY;
+   float windowOffsetX, windowOffsetY;
 
    float getFarDZ() const;
    geom::vec3 getDirX() const;
@@ -28,6 +41,9 @@ public:
       ,	horFov (radians(nuHorFov / 2.f))
       , verFov (atan(tan(horFov) / aspRatio))
       ,	nearDZ (nuNearDZ), planesDZ (nuPlanesDZ)
+      , jitterX (0.f), jitterY (0.f)
+      , windowScaleX (1.f), windowScaleY (1.f)
+      , windowOffsetX (0.f), windowOffsetY (0.f)
    {}
 
    /*
@@ -46,13 +62,44 @@ public:
    //application of perspective (ie dividing x and y by z).
    geom::mat4 getPerspectiveMatrix() const;
 
+   //Both of the above: world coords to clip coords
+   geom::mat4 getTransformMatrix() const;
+
+   //How much the perspective matrix scales y by (before the divide by
+   //depth), i.e. NDC units per world unit at a depth of 1. With a
+   //window, that's NDC of the window.
+   float getProjectionScaleY() const;
+
    geom::vec3 getPos() const;
    void setPos(geom::vec3 nuPos);
 
    geom::vec3 getZ() const;
    geom::vec3 getY() const { return dirY; } //TODO remove
 
+   cameraPose getPose() const;
+   void setPose(const cameraPose& pose);
+
    void setAspectRatio(float aspRatio);
+
+   //Shift the whole image by x, y in NDC (e.g. by part of a sample,
+   //for temporal accumulation); the perspective matrix includes it.
+   void setJitter(float x, float y);
+
+   /*
+     Draw only part of the image - left to right, bottom to top, in its
+     NDC - stretched to fill the whole of what's drawn into, e.g. to
+     render it in tiles. The jitter is then in NDC of the part.
+     (-1, -1, 1, 1) is the whole image again.
+   */
+   void setWindow(float left, float bottom, float right, float top);
+
+   /*
+     One of numViews side by side (numbered from the left), as for a
+     wall of monitors: each with this one's vertical field of view, its
+     own aspect ratio, and turned about the Y axis so its edges meet
+     its neighbours'. The wall's middle faces where this one does.
+   */
+   frustum getWallView(unsigned int index, unsigned int numViews, float aspRatio) const;
 };
 
 class camera : public frustum
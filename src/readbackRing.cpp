@@ -0,0 +1,131 @@
+#include "../lib/glad/include/glad/glad.h"
+
+#include "readbackRing.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace std;
+
+readbackRing::readbackRing(GLuint depth)
+   : ring (depth ? depth : 1)
+   , oldest (0)
+   , next (0)
+   , numPending (0)
+   , waitSeconds (0.0)
+{
+   for (slot& s : ring)
+   {
+      glGenBuffers(1, &s.pbo);
+
+      s.fence = 0;
+      s.capacity = 0;
+      s.width = 0; s.height = 0;
+      s.frameNumber = 0;
+   }
+
+   LOG_GL();
+}
+
+readbackRing::~readbackRing()
+{
+   for (slot& s : ring)
+   {
+      if (s.fence) { glDeleteSync(s.fence); }
+
+      glDeleteBuffers(1, &s.pbo);
+   }
+}
+
+void readbackRing::read(image& img, framebuffer& fb, size_t frameNumber)
+{
+   //The caller should have taken it
+   if (full()) { return; }
+
+   slot& s = ring[next];
+
+   GLuint width, height;
+   img.getSize(width, height);
+
+   size_t bytes = (size_t) width * (size_t) height * 4;
+
+   //Only reallocated when the frame's grown; the driver can then keep
+   //the buffer where it's quickest to map for reading.
+   if (bytes > s.capacity)
+   {
+      glBindBuffer(GL_PIXEL_PACK_BUFFER, s.pbo);
+      glBufferData(GL_PIXEL_PACK_BUFFER, bytes, nullptr, GL_STREAM_READ);
+      glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+      s.capacity = bytes;
+   }
+
+   img.read(fb, s.pbo);
+
+   s.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+   s.width = (GLint) width; s.height = (GLint) height;
+   s.frameNumber = frameNumber;
+
+   next = (next + 1) % ring.size();
+   ++numPending;
+
+   LOG_GL();
+}
+
+bool readbackRing::take(vector<uint8_t>& rgba, GLint& width, GLint& height,
+			size_t& frameNumber, bool wait)
+{
+   if (empty()) { return false; }
+
+   slot& s = ring[oldest];
+
+   if (!wait)
+   {
+      GLenum result = glClientWaitSync(s.fence, 0, 0);
+
+      if ((result != GL_ALREADY_SIGNALED) && (result != GL_CONDITION_SATISFIED))
+      {
+	 return false;
+      }
+   }
+
+   else { waitForFence(s.fence, waitSeconds); }
+
+   glDeleteSync(s.fence);
+   s.fence = 0;
+
+   size_t bytes = (size_t) s.width * (size_t) s.height * 4;
+
+   rgba.resize(bytes);
+
+   glBindBuffer(GL_PIXEL_PACK_BUFFER, s.pbo);
+
+   const void* mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, bytes, GL_MAP_READ_BIT);
+
+   if (mapped)
+   {
+      memcpy(rgba.data(), mapped, bytes);
+
+      glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+   }
+
+   //Still a frame, so the numbering carries on
+   else
+   {
+      cerr << "Couldn't map frame " << s.frameNumber << " for reading back" << endl;
+
+      fill(rgba.begin(), rgba.end(), 0);
+   }
+
+   glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+   width = s.width; height = s.height;
+   frameNumber = s.frameNumber;
+
+   oldest = (oldest + 1) % ring.size();
+   --numPending;
+
+   LOG_GL();
+
+   return true;
+}
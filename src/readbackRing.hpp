@@ -0,0 +1,61 @@
+#pragma once
+
+#include "compute.hpp"
+
+class readbackRing
+/*
+  Reads frames back without waiting for them. Each read goes into a
+  pixel buffer object of its own, and is fenced; it's only mapped once
+  the fence is signalled, some frames later, so the CPU can carry on
+  submitting the frames after it in the meantime rather than stalling
+  on glReadPixels().
+
+  The ring only needs to be deeper than the frames the GPU is behind
+  by for take() never to have to wait.
+*/
+{
+private:
+   struct slot
+   {
+      GLuint pbo;
+      //0 when there's no read pending in it
+      GLsync fence;
+
+      //As allocated, and as read
+      size_t capacity;
+      GLint width, height;
+
+      size_t frameNumber;
+   };
+
+   //Oldest is the next take(); next the next read()
+   std::vector<slot> ring;
+   GLuint oldest;
+   GLuint next;
+   GLuint numPending;
+
+   //Time take() spent waiting on the GPU
+   double waitSeconds;
+
+public:
+   readbackRing(GLuint depth);
+   ~readbackRing();
+
+   //No slot free: take() the oldest before reading another
+   bool full() const { return numPending == ring.size(); }
+   bool empty() const { return !numPending; }
+
+   //Start reading img (through fb, which must have it) back, as
+   //frameNumber
+   void read(image& img, framebuffer& fb, size_t frameNumber);
+
+   /*
+     The oldest read, as RGBA, bottom row first. False if there's none,
+     or if it's not done yet and wait is false; otherwise it waits for
+     it. A buffer that can't be mapped comes back black.
+   */
+   bool take(std::vector<uint8_t>& rgba, GLint& width, GLint& height,
+	     size_t& frameNumber, bool wait);
+
+   double getWaitSeconds() const { return waitSeconds; }
+};
@@ -0,0 +1,691 @@
+#include "../lib/glad/include/glad/glad.h"
+
+#include "renderer.hpp"
+#include "pcdReader.hpp"
+
+using namespace std;
+
+static const char* surfelsShaderName = "resources/shaders/surfelsToSamples.c.glsl";
+static const char* resolveShaderName = "resources/shaders/samplesToPixels.c.glsl";
+//Goes with the resolve shader, to draw it over the window
+static const char* presentShaderName = "resources/shaders/fullscreen.v.glsl";
+
+//Workgroup sizes found by kernelTuner, per GPU
+static const char* tuningCacheFileName = "build/kernels.cache";
+
+const vector<string> profiledPassNames =
+   {"render", "fill", "resolve", "blit", "present", "readback", "clear"};
+
+namespace
+{
+   GLuint getSamplesDimension(int frameDimension, float supersample)
+   {
+      //Round up, so a non-integer factor still covers every pixel
+      return (GLuint) ceil((float) frameDimension * supersample);
+   }
+
+   shaderDefines getResolveDefines(const options& opts)
+   {
+      shaderDefines defines;
+
+      switch (opts.filter)
+      {
+	 case resolveFilter::none: { defines["FILTER"] = "FILTER_NONE"; } break;
+	 case resolveFilter::box: { defines["FILTER"] = "FILTER_BOX"; } break;
+	 case resolveFilter::tent: { defines["FILTER"] = "FILTER_TENT"; } break;
+      }
+
+      //to_string() always gives a decimal point, so it's a GLSL float
+      defines["SUPERSAMPLE"] = to_string(opts.supersample);
+
+      defines["TEMPORAL"] = opts.temporalGrid ? "1" : "0";
+
+      defines["PRESENT"] = opts.directPresent ? "1" : "0";
+
+      return defines;
+   }
+
+   shaderDefines getSurfelsDefines(const options& opts)
+   {
+      shaderDefines defines;
+
+      defines["SPLAT"] = opts.splat ? "1" : "0";
+      defines["MAX_SPLAT_RADIUS"] = to_string(opts.maxSplatRadius);
+
+      //0 draws every surfel, rather than clusters from a culled list
+      defines["CLUSTER_SIZE"] = to_string(opts.cull ? occlusionCuller::clusterSize : 0);
+
+      defines["TEMPORAL"] = opts.temporalGrid ? "1" : "0";
+
+      defines["VIEWS"] = to_string(opts.numViews);
+
+      //Live sweeps are drawn as instances too
+      defines["SCENE"] = (opts.sceneFileName.size() || opts.liveSweeps) ? "1" : "0";
+
+      return defines;
+   }
+}
+
+camera getStartCamera(GLint transformLoc, float aspectRatio)
+{
+   return camera(transformLoc,
+		 geom::vec3(0.0, 0.0, -500.0), //pos
+		 geom::vec3(0.0, 0.0, 1.0), //dirZ
+		 geom::vec3(0.0, 1.0, 0.0), //dirY
+		 35.f, //horizontal fov
+		 aspectRatio,
+		 1.f, 1000.f); //near, planes z
+}
+
+renderer::renderer(const options& opts, int width, int height)
+   : opts (opts)
+     //With the shaders' own workgroup sizes til they're tuned (below)
+   , surfelsToSamples (surfelsShaderName, getSurfelsDefines(opts))
+   , samplesToPixels (resolveShaderName, getResolveDefines(opts),
+		      opts.directPresent ? presentShaderName : "")
+     //Ad hoc locations, from the shaders - for width/height
+   , samples (3)
+   , pixels (5)
+     //Sized by pixelsXY, like pixels
+   , history (-1, GL_RG32F)
+   , historyFrames (0)
+   , filler (opts.fillLevels)
+   , nextSweep (0)
+   , cam (getStartCamera(glGetUniformLocation(surfelsToSamples.getHandle(), "perspective"),
+			 (float) width / (float) height))
+   , width (width)
+   , height (height)
+   , emptyVertexArray (0)
+{
+   LOG_GL();
+
+   //Programs have to be used while uniforms are loaded
+   surfelsToSamples.use();
+   samples.prep(getSamplesDimension(width, opts.supersample),
+		getSamplesDimension(height, opts.supersample));
+
+   samplesToPixels.use();
+   pixels.prep(width, height);
+   pushSamplesSize();
+
+   LOG_GL();
+
+   GLuint samplesX, samplesY;
+   samples.getSize(samplesX, samplesY);
+
+   filler.prep(samplesX, samplesY);
+
+   LOG_GL();
+
+   //Bind images to texture units
+   samples.use(1, GL_READ_WRITE, GL_R32UI);
+   pixels.use(2, GL_WRITE_ONLY);
+
+   if (opts.temporalGrid)
+   {
+      history.prep(width, height);
+      history.use(5, GL_READ_WRITE, GL_RG32F);
+   }
+
+   LOG_GL();
+
+   const GLuint surfelsBinding = 3;
+   const GLuint instancesBinding = 8;
+
+   if (opts.sceneFileName.size())
+   {
+      scene.prep(opts.sceneFileName, surfelsBinding, instancesBinding);
+
+      scene.printStats();
+   }
+
+   //Empty til sweeps come in
+   else if (opts.listenAddress.size())
+   {
+      live.prep(opts.liveSweeps + opts.framesInFlight + 1, opts.maxSweepSurfels,
+		surfelsBinding, instancesBinding);
+   }
+
+   else if (opts.liveSweeps)
+   {
+      pcdReader pcd;
+
+      pcd.prep("resources/models/" + opts.modelFileName);
+
+      feed = pcd.read();
+
+      size_t numSurfels = feed.size() / 4;
+
+      /*
+	Enough slots over the sweeps kept that a retired one's never
+	still being drawn when it's written again, with a sweep coming
+	in no more than once a frame.
+      */
+      live.prep(opts.liveSweeps + opts.framesInFlight + 1,
+		(numSurfels + opts.liveSweeps - 1) / opts.liveSweeps,
+		surfelsBinding, instancesBinding);
+
+      //The whole model, to start with (and to tune with)
+      for (GLuint i = 0; i < opts.liveSweeps; ++i) { feedLive(); }
+   }
+
+   else
+   {
+      //Culling needs surfels in clusters; bounds include splats
+      surfels.prep("resources/models/" + opts.modelFileName, surfelsBinding,
+		   opts.cull ? occlusionCuller::clusterSize : 0,
+		   opts.splat ? opts.splatRadius : 0.f);
+   }
+
+   LOG_GL();
+
+   if (opts.cull) { culler.prep(surfels, samplesX, samplesY); }
+
+   LOG_GL();
+
+   kernelConfig splatConfig, resolveConfig;
+
+   if (opts.tune)
+   {
+      tuneKernels(splatConfig, resolveConfig);
+
+      shaderDefines surfelsDefines = getSurfelsDefines(opts);
+      splatConfig.addDefines(surfelsDefines);
+
+      shaderDefines resolveDefines = getResolveDefines(opts);
+      resolveConfig.addDefines(resolveDefines);
+
+      surfelsToSamples.rebuild(surfelsDefines);
+      samplesToPixels.rebuild(resolveDefines);
+
+      //The new programs have none of the old ones' uniforms
+      surfelsToSamples.use();
+      samples.pushSize();
+
+      samplesToPixels.use();
+      pixels.pushSize();
+      pushSamplesSize();
+   }
+
+   LOG_GL();
+
+   //Get the local sizes from those shaders.
+   glGetProgramiv(surfelsToSamples.getHandle(), GL_COMPUTE_WORK_GROUP_SIZE, surfelsSizes);
+
+   if (opts.directPresent)
+   {
+      //The triangle's corners come from gl_VertexID, but drawing
+      //still needs a vertex array bound.
+      glGenVertexArrays(1, &emptyVertexArray);
+   }
+
+   else
+   {
+      glGetProgramiv(samplesToPixels.getHandle(), GL_COMPUTE_WORK_GROUP_SIZE, resolveSizes);
+   }
+
+   //Workgroup counts only change with the model or frame size, so
+   //they're worked out here (and on resizing) rather than every frame.
+   planSurfels(surfelsSizes[0], surfelsSizes[1], splatConfig.perInvocation);
+
+   planResolve();
+
+   surfelsToSamples.use();
+   pushSurfelsUniforms();
+
+   LOG_GL();
+}
+
+renderer::~renderer()
+{
+   glDeleteVertexArrays(1, &emptyVertexArray);
+}
+
+size_t renderer::getNumSurfels() const
+{
+   if (opts.sceneFileName.size()) { return scene.getNumSurfels(); }
+   if (opts.liveSweeps) { return live.getNumSurfels(); }
+
+   return surfels.getNumSurfels();
+}
+
+void renderer::planSurfels(int localX, int localY, int perInvocation)
+{
+   if (opts.sceneFileName.size()) { scene.planRender(localX, localY, perInvocation); }
+
+   else if (opts.liveSweeps) { live.planRender(localX, localY, perInvocation); }
+
+   else { surfels.planRender(localX, localY, perInvocation); }
+}
+
+void renderer::renderSurfels()
+{
+   if (opts.sceneFileName.size()) { scene.render(); }
+
+   else if (opts.liveSweeps) { live.render(); }
+
+   else { surfels.render(); }
+}
+
+void renderer::feedLive()
+{
+   //Listening, sweeps only come from the socket
+   if (!opts.liveSweeps || opts.listenAddress.size()) { return; }
+
+   size_t numSurfels = feed.size() / 4;
+   size_t sweepSurfels = live.getSlotSurfels();
+
+   size_t first = nextSweep * sweepSurfels;
+   size_t count = (first < numSurfels) ? min(sweepSurfels, numSurfels - first) : 0;
+
+   appendLive(feed.data() + first * 4, count);
+
+   nextSweep = (nextSweep + 1) % opts.liveSweeps;
+}
+
+void renderer::appendLive(const float* data, size_t numSurfels)
+{
+   if (!opts.liveSweeps) { return; }
+
+   //Keeping as many as the model's cut into, or as were asked for
+   if (live.getNumSweeps() == opts.liveSweeps) { live.expire(); }
+
+   live.append(data, numSurfels);
+}
+
+void renderer::pushSamplesSize()
+{
+   //NB: samplesToPixels must be in use.
+
+   //Location from the shader
+   const GLint samplesXYLoc = 7;
+
+   GLuint samplesX, samplesY;
+   samples.getSize(samplesX, samplesY);
+
+   glUniform2ui(samplesXYLoc, samplesX, samplesY);
+}
+
+void renderer::pushSplatScale()
+{
+   //NB: surfelsToSamples must be in use.
+
+   //Location from the shader
+   const GLint radiusScaleLoc = 4;
+
+   GLuint samplesX, samplesY;
+   samples.getSize(samplesX, samplesY);
+
+   //NDC span 2 units over the image's height
+   glUniform1f(radiusScaleLoc,
+	       cam.getProjectionScaleY() * (float) samplesY / 2.f);
+}
+
+void renderer::pushTransforms(float jitterX, float jitterY)
+{
+   //NB: surfelsToSamples must be in use.
+
+   GLuint samplesX, samplesY;
+   samples.getSize(samplesX, samplesY);
+
+   if (opts.numViews == 1)
+   {
+      //NDC span 2 units over the image
+      cam.setJitter(2.f * jitterX / (float) samplesX, 2.f * jitterY / (float) samplesY);
+      cam.pushTransformMatrix();
+
+      return;
+   }
+
+   //Location from the shader; one per view from there
+   const GLint viewsLoc = 8;
+
+   vector<geom::mat4> transforms;
+
+   for (GLuint i = 0; i < opts.numViews; ++i)
+   {
+      //Its strip of the samples, as in the shader's getStrip()
+      GLuint stripX = (i + 1) * samplesX / opts.numViews - i * samplesX / opts.numViews;
+
+      frustum view = cam.getWallView(i, opts.numViews, (float) stripX / (float) samplesY);
+
+      view.setJitter(2.f * jitterX / (float) stripX, 2.f * jitterY / (float) samplesY);
+
+      transforms.push_back(view.getTransformMatrix());
+   }
+
+   glUniformMatrix4fv(viewsLoc, opts.numViews, false, (GLfloat*) transforms.data());
+}
+
+void renderer::pushSurfelsUniforms()
+{
+   //NB: surfelsToSamples must be in use.
+   pushTransforms();
+
+   if (opts.splat)
+   {
+      const GLint surfelRadiusLoc = 5;
+
+      glUniform1f(surfelRadiusLoc, opts.splatRadius);
+
+      pushSplatScale();
+   }
+
+   pushFootprint();
+}
+
+void renderer::pushFootprint()
+{
+   //Splats are drawn whole, so only points have a footprint
+   if (opts.splat || !opts.temporalGrid) { return; }
+
+   const GLint footprintLoc = 6;
+
+   //Width of the part of a sample the frame draws, in samples: all of
+   //it for the plain frame after a reset
+   float footprint = historyFrames ? 1.f / (float) opts.temporalGrid : 1.f;
+
+   glUniform1f(footprintLoc, footprint);
+}
+
+void renderer::tuneKernels(kernelConfig& splatConfig, kernelConfig& resolveConfig)
+{
+   //The benchmark is the first frame, drawn by each variant in turn
+   kernelTuner tuner = kernelTuner(tuningCacheFileName);
+
+   GLuint clusterSize = opts.cull ? occlusionCuller::clusterSize : 0;
+
+   splatConfig = tuner.choose(
+      surfelsShaderName, getSurfelsDefines(opts), getSplatCandidates(clusterSize),
+      [&](program& variant, const kernelConfig& config)
+      {
+	 //Just the first phase: with no pyramid yet, that's
+	 //everything in view.
+	 if (opts.cull) { culler.cull(0, cam.getTransformMatrix(), samples); }
+
+	 variant.use();
+	 samples.pushSize();
+	 pushSurfelsUniforms();
+
+	 if (opts.cull) { culler.draw(0); }
+
+	 else
+	 {
+	    planSurfels(config.localX, config.localY, config.perInvocation);
+	    renderSurfels();
+	 }
+
+	 glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+      },
+      opts.retune);
+
+   //Drawn, rather than dispatched, there's no workgroup size to pick
+   if (!opts.directPresent)
+   {
+      GLuint pixelsX, pixelsY;
+      pixels.getSize(pixelsX, pixelsY);
+
+      resolveConfig = tuner.choose(
+	 resolveShaderName, getResolveDefines(opts), getResolveCandidates(),
+	 [&](program& variant, const kernelConfig& config)
+	 {
+	    variant.use();
+	    pixels.pushSize();
+	    pushSamplesSize();
+
+	    uint32_t xWkgps, yWkgps;
+
+	    getWkgpDimensions(xWkgps, yWkgps,
+			      config.localX, config.localY,
+			      pixelsX, pixelsY);
+
+	    glDispatchCompute(xWkgps, yWkgps, 1);
+	 },
+	 opts.retune);
+   }
+
+   samples.clear();
+   pixels.clear();
+
+   LOG_GL();
+}
+
+void renderer::renderCulled()
+{
+   geom::mat4 transform = cam.getTransformMatrix();
+
+   for (GLuint phase = 0; phase < 2; ++phase)
+   {
+      culler.cull(phase, transform, samples);
+
+      surfelsToSamples.use();
+      culler.draw(phase);
+
+      glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+
+      //After phase 0, for phase 1 to test against; after phase 1,
+      //for the next frame's phase 0.
+      culler.updateHiZ(samples);
+   }
+}
+
+void renderer::planResolve()
+{
+   if (opts.directPresent) { return; }
+
+   //One invocation per pixel
+   if (!resolvePlan.plan(resolveSizes[0], resolveSizes[1], width, height))
+   {
+      cerr << "Frame is too big for the resolve pass's workgroups" << endl;
+   }
+}
+
+void renderer::resize(int nuWidth, int nuHeight)
+{
+   width = nuWidth; height = nuHeight;
+
+   //These also do associated uniforms - so need their programs
+   surfelsToSamples.use();
+   samples.resize(getSamplesDimension(width, opts.supersample),
+		  getSamplesDimension(height, opts.supersample));
+
+   GLuint samplesX, samplesY;
+   samples.getSize(samplesX, samplesY);
+
+   filler.resize(samplesX, samplesY);
+   culler.resize(samplesX, samplesY);
+
+   samplesToPixels.use();
+   pixels.resize(width, height);
+   pushSamplesSize();
+
+   //Either may have a new texture now
+   samples.use(1, GL_READ_WRITE, GL_R32UI);
+   pixels.use(2, GL_WRITE_ONLY);
+
+   if (opts.temporalGrid)
+   {
+      history.resize(width, height);
+      history.use(5, GL_READ_WRITE, GL_RG32F);
+   }
+
+   planResolve();
+
+   //Don't update aspect ratio based on new sizes though - it's weird.
+   //But the splat scale depends on the samples image's size.
+   updateCamera();
+}
+
+GLuint renderer::getFramesToSettle() const
+{
+   return opts.temporalGrid ? opts.temporalGrid * opts.temporalGrid + 1 : 1;
+}
+
+bool renderer::isSettled() const
+{
+   return opts.temporalGrid && (historyFrames >= getFramesToSettle());
+}
+
+void renderer::updateCamera()
+{
+   bool settled = isSettled();
+
+   //The old average is of another view
+   historyFrames = 0;
+
+   //Left as they were while it was settled (see clear())
+   if (settled) { clear(); }
+
+   surfelsToSamples.use();
+
+   pushTransforms();
+
+   if (opts.splat) { pushSplatScale(); }
+
+   LOG_GL();
+}
+
+bool renderer::jitter()
+{
+   const GLint historyWeightLoc = 6;
+   const GLint historyShownLoc = 8;
+
+   GLuint grid = opts.temporalGrid;
+   GLuint numCells = grid * grid;
+
+   /*
+     Once every cell's been drawn the average is all there is to get
+     of this view, so nothing more is drawn til the camera moves. The
+     pixels are still there to be shown again; presenting directly,
+     they're resolved again, from the history alone.
+   */
+   if (isSettled())
+   {
+      samplesToPixels.use();
+      glUniform1f(historyWeightLoc, 0.f);
+      glUniform1f(historyShownLoc, 1.f);
+
+      return false;
+   }
+
+   /*
+     A frame drawing just one cell of each sample would only have a
+     fraction of the points in it, so the first after a reset draws
+     them all, unjittered, and it's shown while the cells come in.
+     Each cell's frame after that goes into an even average of them,
+     which takes over from the plain frame a cell at a time; once
+     they're all in, it's all that's shown.
+   */
+   float x = 0.f, y = 0.f;
+   float weight = 1.f, shown = 0.f;
+
+   if (historyFrames)
+   {
+      /*
+	The part of the sample (cell of the grid) this frame draws.
+	Going grid + 1 cells at a time (which has no factor in common
+	with the number of cells) visits every one, and spreads them
+	out across the sample, rather than doing a row at a time.
+      */
+      GLuint cell = ((historyFrames - 1) * (grid + 1)) % numCells;
+
+      //From the sample's centre, in samples
+      x = ((float) (cell % grid) + 0.5f) / (float) grid - 0.5f;
+      y = ((float) (cell / grid) + 0.5f) / (float) grid - 0.5f;
+
+      weight = 1.f / (float) historyFrames;
+      shown = (float) historyFrames / (float) numCells;
+   }
+
+   surfelsToSamples.use();
+   pushTransforms(x, y);
+   pushFootprint();
+
+   samplesToPixels.use();
+   glUniform1f(historyWeightLoc, weight);
+   glUniform1f(historyShownLoc, shown);
+
+   ++historyFrames;
+
+   LOG_GL();
+
+   return true;
+}
+
+void renderer::draw(gpuProfiler& profiler)
+{
+   if (opts.temporalGrid && !jitter()) { return; }
+
+   profiler.begin(passRender);
+
+   if (opts.cull)
+   {
+      renderCulled(); LOG_GL();
+   }
+
+   else
+   {
+      surfelsToSamples.use(); LOG_GL();
+
+      renderSurfels(); LOG_GL();
+
+      //Block until all image ops in the previous shader are done
+      //(more or less).
+      glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+   }
+
+   profiler.end(passRender);
+
+   //Optional; does nothing with no levels
+   profiler.begin(passFill);
+   filler.fill(samples); LOG_GL();
+   profiler.end(passFill);
+
+   //Resolved as it's presented
+   if (opts.directPresent)
+   {
+      glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+
+      return;
+   }
+
+   profiler.begin(passResolve);
+
+   samplesToPixels.use(); LOG_GL();
+
+   resolvePlan.dispatch(); LOG_GL();
+
+   //For whatever reads the pixels next: blitting or reading back
+   glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_FRAMEBUFFER_BARRIER_BIT);
+
+   profiler.end(passResolve);
+}
+
+void renderer::present()
+{
+   samplesToPixels.use();
+
+   //Nothing else draws, so nothing's kept it in step with resizes
+   glViewport(0, 0, width, height);
+
+   glBindVertexArray(emptyVertexArray);
+
+   glDrawArrays(GL_TRIANGLES, 0, 3);
+
+   glBindVertexArray(0);
+
+   LOG_GL();
+}
+
+void renderer::clear()
+{
+   //The next frame shows these again, unless the camera moves first
+   if (isSettled()) { return; }
+
+   samples.clear();
+
+   //Nothing's written there, presenting directly
+   if (!opts.directPresent) { pixels.clear(); }
+
+   LOG_GL();
+}
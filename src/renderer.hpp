@@ -0,0 +1,156 @@
+#pragma once
+
+#include "compute.hpp"
+#include "projection.hpp"
+#include "options.hpp"
+#include "holeFiller.hpp"
+#include "occlusionCuller.hpp"
+#include "kernelTuner.hpp"
+#include "gpuProfiler.hpp"
+#include "surfelScene.hpp"
+#include "liveSurfels.hpp"
+
+//Parts of the frame timed by gpuProfiler. Blit (or, presenting
+//directly, present - which is the resolve too) is the windowed front
+//end's; readback the headless one's.
+enum profiledPass
+{
+   passRender,
+   passFill,
+   passResolve,
+   passBlit,
+   passPresent,
+   passReadback,
+   passClear
+};
+
+extern const std::vector<std::string> profiledPassNames;
+
+//Where every run starts, looking at the model
+camera getStartCamera(GLint transformLoc, float aspectRatio);
+
+class renderer
+/*
+  The pipeline from a model to a frame of pixels: surfelsToSamples
+  (with culling, if on), hole filling, then samplesToPixels. It only
+  needs a current GL context, so the windowed and headless front ends
+  (see main.cpp) share it; getting the pixels to a screen or a file is
+  theirs to do.
+*/
+{
+private:
+   options opts;
+
+   program surfelsToSamples;
+   program samplesToPixels;
+
+   image samples;
+   image pixels;
+
+   //With temporal accumulation: each pixel's average over the frames
+   //since the camera last moved, alongside the plain frame drawn first
+   //(see jitter()), and how many frames that is
+   image history;
+   GLuint historyFrames;
+
+   holeFiller filler;
+   surfelModel surfels;
+   //In place of surfels, given a scene
+   surfelScene scene;
+
+   //Or, live, the model fed in a sweep at a time (see feedLive()),
+   //from its surfels kept on the CPU
+   liveSurfels live;
+   std::vector<float> feed;
+   size_t nextSweep;
+   occlusionCuller culler;
+
+   camera cam;
+
+   //Local sizes of the two programs, as built
+   int surfelsSizes[3];
+   int resolveSizes[3];
+
+   dispatchPlan resolvePlan;
+
+   int width, height;
+
+   //Presenting directly, for drawing without vertex buffers
+   GLuint emptyVertexArray;
+
+   void tuneKernels(kernelConfig& splatConfig, kernelConfig& resolveConfig);
+
+   //The camera's transform, or with several views, each of theirs;
+   //offset by jitterX, jitterY samples
+   void pushTransforms(float jitterX = 0.f, float jitterY = 0.f);
+   void pushSplatScale();
+   //The resolve's bounds on the samples it filters
+   void pushSamplesSize();
+   void pushSurfelsUniforms();
+   //The part of each sample points are drawn in, with temporal
+   //accumulation
+   void pushFootprint();
+
+   //Either the model's or the scene's
+   void planSurfels(int localX, int localY, int perInvocation);
+   void renderSurfels();
+
+   void renderCulled();
+   void planResolve();
+
+   //Offset the camera by part of a sample, differently each frame
+   //since the last reset, and weight the frame in the history. False
+   //once the view's settled, with nothing left to draw.
+   bool jitter();
+
+public:
+   //Throws if the model can't be loaded
+   renderer(const options& opts, int width, int height);
+   ~renderer();
+
+   camera& getCamera() { return cam; }
+   image& getPixels() { return pixels; }
+   void getSize(int& x, int& y) const { x = width; y = height; }
+   //Drawn each frame
+   size_t getNumSurfels() const;
+   const liveSurfels& getLive() const { return live; }
+
+   //Resizes the images to go with a new frame size
+   void resize(int nuWidth, int nuHeight);
+
+   //After moving the camera (or resizing). Starts the history again.
+   void updateCamera();
+
+   //Frames drawn after updateCamera() til they'd all look the same:
+   //with temporal accumulation, the plain one and one per cell of the
+   //grid; otherwise just the one
+   GLuint getFramesToSettle() const;
+   //So the next draw() has nothing to do
+   bool isSettled() const;
+
+   /*
+     Render, fill and resolve; the pixels image is ready to read
+     afterwards. Presenting directly, the resolve is left to present().
+     With temporal accumulation, once the view's settled, nothing's
+     drawn: the pixels are left as they were, to be shown again.
+   */
+   void draw(gpuProfiler& profiler);
+
+   /*
+     Live: the next sweep comes in, in place of the oldest. It's the
+     next of opts.liveSweeps parts of the model, in turn, standing in
+     for a sensor.
+   */
+   void feedLive();
+
+   //Live: a sweep from elsewhere (see sweepReceiver), as feedLive()
+   void appendLive(const float* data, size_t numSurfels);
+
+   //Presenting directly: resolve straight into the framebuffer bound
+   //for drawing (the window's), at its size, instead of into the
+   //pixels image to be blitted there.
+   void present();
+
+   //For the next frame; unless it's settled, so the images are kept
+   void clear();
+};
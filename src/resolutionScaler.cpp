@@ -0,0 +1,139 @@
+#include "../lib/glad/include/glad/glad.h"
+
+#include "resolutionScaler.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+
+using namespace std;
+
+//Frames timed at a scale before it's judged
+static const unsigned int settleFrames = 16;
+
+//Weight of each new frame in the moving average
+static const double smoothing = 0.15;
+
+//Aim a little under the target, so ordinary variation doesn't push
+//frames over it
+static const double aimFraction = 0.9;
+
+//Only go back up once frames are well under the target; in between
+//it's close enough, so the scale doesn't hunt with the noise.
+static const double raiseFraction = 0.75;
+
+//Changes smaller than this (as a fraction of the scale) aren't worth
+//a resize
+static const float minChange = 0.05f;
+
+//Most a scale changes by at once; down quicker than up, since frames
+//over the target are worse than frames under it
+static const float maxDown = 0.7f;
+static const float maxUp = 1.1f;
+
+resolutionScaler::resolutionScaler(float targetMs, float minScale)
+   : slotScales (timestampRing::ringSize, 0.f)
+   , targetMs (targetMs)
+   , minScale (minScale)
+   , scale (1.f)
+   , smoothedMs (0.0)
+   , numTimed (0)
+   , lastReport (clock::now())
+   , numChanges (0)
+   , enabled (targetMs > 0.f)
+{
+   if (enabled) { ring.prep(1); }
+}
+
+void resolutionScaler::read(GLuint slot)
+{
+   //From before the last change; says nothing about this scale
+   if (slotScales[slot] != scale) { return; }
+
+   double ms = ring.getMs(slot, 0);
+
+   smoothedMs = numTimed ? smoothedMs + smoothing * (ms - smoothedMs) : ms;
+   ++numTimed;
+}
+
+void resolutionScaler::beginFrame()
+{
+   if (!enabled) { return; }
+
+   ring.collect([this](GLuint slot) { read(slot); });
+
+   //Still waiting on it: just don't time this frame
+   if (!ring.beginFrame()) { return; }
+
+   slotScales[ring.getCurrent()] = scale;
+
+   ring.stamp(0, true);
+}
+
+void resolutionScaler::endFrame()
+{
+   if (!enabled) { return; }
+
+   ring.stamp(0, false);
+   ring.endFrame();
+
+   LOG_GL();
+}
+
+bool resolutionScaler::update()
+{
+   if (!enabled || (numTimed < settleFrames)) { return false; }
+
+   if ((smoothedMs <= targetMs) && (smoothedMs >= raiseFraction * targetMs)) { return false; }
+
+   /*
+     Most of a frame's time goes on things proportional to its area
+     (clearing, resolving, filling), so scale each side by the root of
+     how far off it is. Splatting the points takes about as long at
+     any size, so that undershoots a little - but it's run again once
+     the next frames are in.
+   */
+   float wanted = scale * (float) sqrt(aimFraction * targetMs / smoothedMs);
+
+   wanted = min(max(wanted, scale * maxDown), scale * maxUp);
+   wanted = min(max(wanted, minScale), 1.f);
+
+   //Close enough - unless it's a last small step to a limit
+   bool atLimit = (wanted == 1.f) || (wanted == minScale);
+
+   if ((wanted == scale) || (!atLimit && (fabs(wanted - scale) < minChange * scale)))
+   {
+      return false;
+   }
+
+   scale = wanted;
+
+   //Start again at the new scale
+   numTimed = 0;
+   ++numChanges;
+
+   return true;
+}
+
+void resolutionScaler::getSize(int windowWidth, int windowHeight, int& width, int& height) const
+{
+   width = max((int) (windowWidth * scale + 0.5f), 1);
+   height = max((int) (windowHeight * scale + 0.5f), 1);
+}
+
+void resolutionScaler::report(double periodSeconds)
+{
+   if (!enabled) { return; }
+
+   clock::time_point now = clock::now();
+
+   if (chrono::duration<double>(now - lastReport).count() < periodSeconds) { return; }
+
+   lastReport = now;
+
+   cout << "Resolution: " << fixed << setprecision(0) << scale * 100.f << "% of the window, "
+	<< setprecision(2) << smoothedMs << "ms on the GPU (target " << targetMs << "ms), "
+	<< numChanges << " changes" << defaultfloat << setprecision(6) << endl;
+
+   numChanges = 0;
+}
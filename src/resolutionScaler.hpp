@@ -0,0 +1,69 @@
+#pragma once
+
+#include "compute.hpp"
+#include "gpuProfiler.hpp"
+
+#include <chrono>
+
+class resolutionScaler
+/*
+  Picks the fraction of the window's width and height to render at,
+  to hold the GPU's time per frame near a target: lower when frames
+  take too long, higher again when there's time to spare. What's
+  rendered is stretched over the window by the blit.
+
+  GPU times come from timestamps either side of each frame, read
+  back once they're there (see timestampRing), so it never stalls.
+  Only frames rendered at the current scale count, and the scale's
+  only changed once enough of them are in, and by enough to matter,
+  so it doesn't hunt. Changing it resizes the images; that's cheap
+  going down, and going back up only returns to sizes already
+  allocated (see texturePool).
+*/
+{
+private:
+   typedef std::chrono::steady_clock clock;
+
+   //Just the whole frame
+   timestampRing ring;
+   //What the frame in each slot was rendered at
+   std::vector<float> slotScales;
+
+   float targetMs;
+   float minScale;
+   float scale;
+
+   //Moving average of frames at the current scale, and how many have
+   //gone into it
+   double smoothedMs;
+   unsigned int numTimed;
+
+   //Since the last report
+   clock::time_point lastReport;
+   unsigned int numChanges;
+
+   bool enabled;
+
+   //Of a frame whose results are in (see timestampRing::collect())
+   void read(GLuint slot);
+
+public:
+   //Off (always at full size) with a targetMs of 0
+   resolutionScaler(float targetMs, float minScale);
+
+   void beginFrame();
+   void endFrame();
+
+   //Between frames: true if the scale's changed, and the images need
+   //resizing to getSize()
+   bool update();
+
+   float getScale() const { return scale; }
+
+   //Of the window, scaled; at least 1x1
+   void getSize(int windowWidth, int windowHeight, int& width, int& height) const;
+
+   //Print the scale and GPU time, if it's been at least periodSeconds
+   //since last time
+   void report(double periodSeconds);
+};
@@ -6,7 +6,7 @@
 
 using namespace std;
 
-sdlInstance::sdlInstance(int winX, int winY)
+sdlInstance::sdlInstance(int winX, int winY, bool vsync)
    : window (nullptr)
    , windowX (winX), windowY (winY)
    , then (0), now(0)
@@ -18,7 +18,7 @@ sdlInstance::sdlInstance(int winX, int winY)
    , mouseDX (0), mouseDY (0)
    , panning (false)
    , panningX (0), panningY (0)
-{ prep(); }
+{ prep(vsync); }
 
 const char*
 sdlInstance::getError()
@@ -31,7 +31,7 @@ sdlInstance::getError()
 }
 
 void
-sdlInstance::prep()
+sdlInstance::prep(bool vsync)
 {
    if (SDL_Init(SDL_INIT_VIDEO) != 0)
    {
@@ -45,6 +45,11 @@ sdlInstance::prep()
    SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK,
 		       SDL_GL_CONTEXT_PROFILE_CORE);
 
+#ifdef GL_CHECKS
+   //Drivers may only give full debug output in a debug context
+   SDL_GL_SetAttribute(SDL_GL_CONTEXT_FLAGS, SDL_GL_CONTEXT_DEBUG_FLAG);
+#endif
+
    uint32_t flags = (SDL_WINDOW_OPENGL |
 		     SDL_WINDOW_RESIZABLE);
 
@@ -72,7 +77,7 @@ sdlInstance::prep()
       cerr << "SDL failed to create OpenGL context: \'" << getError() << endl;
    }
 
-   if (SDL_GL_SetSwapInterval(1) == -1)
+   if (SDL_GL_SetSwapInterval(vsync ? 1 : 0) == -1)
    {
       //TODO
 
@@ -110,6 +115,24 @@ sdlInstance::swapWindow()
    SDL_GL_SwapWindow(window);
 }
 
+void
+sdlInstance::releaseContext()
+{
+   if (SDL_GL_MakeCurrent(window, nullptr) != 0)
+   {
+      cerr << "SDL failed to release OpenGL context: \'" << getError() << endl;
+   }
+}
+
+void
+sdlInstance::makeContextCurrent()
+{
+   if (SDL_GL_MakeCurrent(window, context) != 0)
+   {
+      cerr << "SDL failed to make OpenGL context current: \'" << getError() << endl;
+   }
+}
+
 void
 sdlInstance::updateLengthFrame()
 {
@@ -279,6 +302,15 @@ sdlInstance::pollEvents()
    then = now;
 }
 
+void
+sdlInstance::waitEvents(int timeoutMs)
+{
+   //With no event to fill in, this leaves them queued for pollEvents()
+   SDL_WaitEventTimeout(nullptr, timeoutMs);
+
+   pollEvents();
+}
+
 bool
 sdlInstance::getQuit() const { return key_quit; }
 
@@ -342,7 +374,7 @@ sdlInstance::hasWindowChanged(int& x, int& y)
    y = windowY;
 
    //Whether it's changed
-   return (oldX == windowX) && (oldY == windowY);
+   return (oldX != windowX) || (oldY != windowY);
 }
 
 void
@@ -42,18 +42,26 @@ private:
    //call. So it makes sense that it's private.
    const char* getError();
 
-   void prep();
+   void prep(bool vsync);
    void quit();
 
 public:
-   sdlInstance(int winX, int winY);
+   //Without vsync, frames are presented as soon as they're done
+   sdlInstance(int winX, int winY, bool vsync = true);
 
    void swapWindow();
+
+   //The context is current on the thread that made the window, til
+   //released; then another thread can take it.
+   void releaseContext();
+   void makeContextCurrent();
    
    bool hasWindowChanged(int& x, int& y);
    void getMouseDelta(int& x, int& y) const;
    
    void pollEvents();
+   //Wait til there are events (or timeoutMs is up), then poll them
+   void waitEvents(int timeoutMs);
 
    uint32_t getLengthFrame() const;
    bool getQuit() const;
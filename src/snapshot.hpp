@@ -0,0 +1,62 @@
+#pragma once
+
+#include <atomic>
+
+template <typename T>
+class snapshot
+/*
+  Hands the latest value of something from one thread to another
+  without locks: a triple buffer. The writer fills a slot of its own,
+  then swaps it for the shared middle one; the reader, when there's
+  something new in the middle, swaps it for its own. Neither ever
+  waits on the other. The reader always gets a whole value, and the
+  latest one, though it may never see some in between.
+
+  Only for one writing thread and one reading thread.
+*/
+{
+private:
+   T slots[3];
+
+   //Index of the middle slot, with fresh set if the writer's put
+   //something there the reader hasn't taken yet
+   std::atomic<unsigned int> middle;
+   static const unsigned int fresh = 4;
+
+   //Only touched by their own threads
+   unsigned int writing;
+   unsigned int reading;
+
+public:
+   //initial counts as new, for the reader's first take()
+   snapshot(const T& initial)
+      : middle (1 | fresh)
+      , writing (0)
+      , reading (2)
+   {
+      for (T& slot : slots) { slot = initial; }
+   }
+
+   //Writer's side
+   void publish(const T& value)
+   {
+      slots[writing] = value;
+
+      //Release the slot's contents to the reader; acquire whatever
+      //slot it last gave back.
+      writing = middle.exchange(writing | fresh, std::memory_order_acq_rel) & ~fresh;
+   }
+
+   //Reader's side; false, leaving value alone, if there's been
+   //nothing new since last time
+   bool take(T& value)
+   {
+      if (!(middle.load(std::memory_order_relaxed) & fresh)) { return false; }
+
+      reading = middle.exchange(reading, std::memory_order_acq_rel) & ~fresh;
+
+      value = slots[reading];
+
+      return true;
+   }
+};
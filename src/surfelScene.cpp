@@ -0,0 +1,171 @@
+#include "../lib/glad/include/glad/glad.h"
+
+#include "surfelScene.hpp"
+#include "pcdReader.hpp"
+
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+
+using namespace std;
+
+surfelScene::surfelScene()
+   : numArenaSurfels (0)
+   , numSurfels (0)
+   , numInstances (0)
+   , numModels (0)
+{}
+
+void surfelScene::prep(const string& fileName, GLuint arenaBinding, GLuint instancesBinding)
+{
+   ifstream file;
+   file.open(fileName, ifstream::in);
+
+   if (!file.is_open())
+   {
+      throw runtime_error("Couldn't read scene \"" + fileName + "\"");
+   }
+
+   vector<float> surfels;
+   vector<sceneInstance> table;
+
+   //Each model's place in the arena, as first surfel and count
+   map<string, pair<size_t, size_t>> loaded;
+
+   string line;
+   size_t lineNumber = 0;
+
+   while (getline(file, line))
+   {
+      ++lineNumber;
+
+      if (!line.size() || (line[0] == '#')) { continue; }
+
+      istringstream values(line);
+
+      string modelName;
+      float x, y, z;
+
+      values >> modelName >> x >> y >> z;
+
+      if (!values)
+      {
+	 throw runtime_error("Bad instance on line " + to_string(lineNumber) +
+			     " of scene \"" + fileName + "\"");
+      }
+
+      //Both optional
+      float yaw = 0.f, scale = 1.f;
+
+      if (values >> yaw) { values >> scale; }
+
+      if (!(scale > 0.f))
+      {
+	 throw runtime_error("Scale must be over 0, on line " + to_string(lineNumber) +
+			     " of scene \"" + fileName + "\"");
+      }
+
+      auto model = loaded.find(modelName);
+
+      if (model == loaded.end())
+      {
+	 pcdReader pcd;
+
+	 pcd.prep("resources/models/" + modelName);
+
+	 vector<float> load = pcd.read();
+
+	 if (load.size() % 4) { throw invalid_argument("Surfel input data not divisible into groups of 4 floats"); }
+
+	 size_t first = surfels.size() / 4;
+
+	 surfels.insert(surfels.end(), load.begin(), load.end());
+
+	 model = loaded.insert({modelName, {first, load.size() / 4}}).first;
+      }
+
+      sceneInstance placed;
+
+      float radians = yaw * (float) M_PI / 180.f;
+      float c = cos(radians) * scale, s = sin(radians) * scale;
+
+      //Turned about Y, scaled, then moved
+      const GLfloat transform[16] = {   c, 0.f,    -s, 0.f,
+				      0.f, scale, 0.f, 0.f,
+					s, 0.f,     c, 0.f,
+					x,   y,     z, 1.f };
+
+      copy(transform, transform + 16, placed.transform);
+
+      placed.first = (GLuint) model->second.first;
+      placed.count = (GLuint) model->second.second;
+      placed.start = (GLuint) numSurfels;
+      placed.scale = scale;
+
+      numSurfels += model->second.second;
+
+      //The shader indexes them all with a uint
+      if (numSurfels > numeric_limits<GLuint>::max())
+      {
+	 throw runtime_error("Scene \"" + fileName + "\" has too many surfels to draw at once");
+      }
+
+      table.push_back(placed);
+   }
+
+   if (!table.size())
+   {
+      throw runtime_error("Scene \"" + fileName + "\" has no instances");
+   }
+
+   numArenaSurfels = surfels.size() / 4;
+   numInstances = table.size();
+   numModels = loaded.size();
+
+   arena.prep(surfels, arenaBinding);
+   instances.prep(table.data(), table.size() * sizeof(sceneInstance), instancesBinding);
+}
+
+bool planInstanced(dispatchPlan& plan, size_t numSurfels,
+		   int localX, int localY, int perInvocation)
+{
+   uint32_t groupSize = (uint32_t) (localX * localY * perInvocation);
+
+   //Round up, as with the workgroups; at least one, so the plan's
+   //never for nothing along x
+   uint32_t numGroups = (uint32_t) max((numSurfels + groupSize - 1) / groupSize, (size_t) 1);
+
+   uint32_t maxX = (uint32_t) getDeviceCapabilities().maxWkgpCount[0];
+
+   uint32_t xWkgps = min(numGroups, maxX);
+   uint32_t yWkgps = (numGroups + xWkgps - 1) / xWkgps;
+
+   if (!plan.plan((uint32_t) localX, (uint32_t) localY, xWkgps * localX, yWkgps * localY))
+   {
+      cerr << "Too many surfels for the render pass's workgroups" << endl;
+
+      return false;
+   }
+
+   return true;
+}
+
+void surfelScene::planRender(int localX, int localY, int perInvocation)
+{
+   planInstanced(renderPlan, numSurfels, localX, localY, perInvocation);
+}
+
+void surfelScene::render()
+{
+   renderPlan.dispatch();
+}
+
+void surfelScene::printStats() const
+{
+   cout << "Scene: " << numInstances << " instance(s) of " << numModels << " model(s); "
+	<< numSurfels << " surfels drawn from " << numArenaSurfels << " in memory" << endl;
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include "compute.hpp"
+
+#include <string>
+#include <vector>
+
+//As surfelsToSamples' instance struct, with SCENE, in std430: a mat4,
+//then the rest packed after it, to 80 bytes
+struct sceneInstance
+{
+   //Column-major, model to world
+   GLfloat transform[16];
+
+   //Its surfels, in the arena
+   GLuint first, count;
+   //Where they start among the ones the dispatch covers
+   GLuint start;
+
+   //For the radii the model gives
+   GLfloat scale;
+};
+
+/*
+  Plans a dispatch of surfelsToSamples (with SCENE) over numSurfels,
+  with its local sizes, each invocation drawing perInvocation. Past the
+  most workgroups there can be along x, they wrap into y. False, having
+  said so, if there'd be too many even so.
+*/
+bool planInstanced(dispatchPlan& plan, size_t numSurfels,
+		   int localX, int localY, int perInvocation);
+
+class surfelScene
+/*
+  Many models, placed about the world, drawn as one. Each model's
+  loaded once, into an arena buffer that takes the place of
+  surfelModel's, however many times it's placed; each placement (an
+  instance) is a row in a table of where its surfels are in the arena
+  and its transform into the world. A single dispatch covers every
+  instance's surfels, one after another, and surfelsToSamples (with
+  SCENE) looks each one's instance up in the table.
+
+  Files are text: a line per instance of a model's file name (in
+  resources/models, as for a single model), then its position, and
+  optionally its turn about the Y axis in degrees and its scale:
+
+    # model x y z [yaw [scale]]
+    ism_train_horse.pcd 0 0 0
+    ism_train_horse.pcd 300 0 0 90 0.5
+*/
+{
+private:
+   buffer arena;
+   buffer instances;
+
+   size_t numArenaSurfels;
+   size_t numSurfels;
+   size_t numInstances;
+   size_t numModels;
+
+   dispatchPlan renderPlan;
+
+public:
+   surfelScene();
+
+   //Throws runtime_error if the file can't be read or has no
+   //instances, and invalid_argument if a model can't be loaded
+   void prep(const std::string& fileName, GLuint arenaBinding, GLuint instancesBinding);
+
+   //As surfelModel::planRender() (see planInstanced())
+   void planRender(int localX, int localY, int perInvocation = 1);
+
+   void render();
+
+   //Drawn each frame, over every instance
+   size_t getNumSurfels() const { return numSurfels; }
+
+   //Say how many instances of how many models there are, and how many
+   //surfels that saved loading
+   void printStats() const;
+};
@@ -0,0 +1,399 @@
+#include "sweepSocket.hpp"
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+using namespace std;
+
+const char sweepMagic[4] = {'S', 'W', 'P', '1'};
+
+namespace
+{
+   //How often the receiving thread looks up to see if it should stop
+   const int pollMs = 100;
+
+   //Room for a burst of packets while the thread's busy
+   const int receiveBufferBytes = 8 * 1024 * 1024;
+
+   const size_t packetBytes = sizeof(sweepPacket) + maxPacketPoints * 4 * sizeof(float);
+
+   /*
+     A datagram socket for address: bound to it, to listen, or
+     connected to it, to send. Throws runtime_error, saying why, if it
+     can't be. socketPath is the Unix domain socket's, if it is one.
+   */
+   int openSocket(const string& address, bool listening, string& socketPath)
+   {
+      int handle = -1;
+
+      if (address.compare(0, 5, "unix:") == 0)
+      {
+	 string path = address.substr(5);
+
+	 sockaddr_un name;
+	 memset(&name, 0, sizeof(name));
+	 name.sun_family = AF_UNIX;
+
+	 if (!path.size() || (path.size() >= sizeof(name.sun_path)))
+	 {
+	    throw runtime_error("Bad Unix socket path in \"" + address + "\"");
+	 }
+
+	 strcpy(name.sun_path, path.c_str());
+
+	 handle = socket(AF_UNIX, SOCK_DGRAM, 0);
+
+	 if (handle < 0) { throw runtime_error("Couldn't make a socket for \"" + address + "\""); }
+
+	 if (listening)
+	 {
+	    //A socket left by an earlier run, but never anything else
+	    struct stat status;
+
+	    if ((stat(path.c_str(), &status) == 0) && S_ISSOCK(status.st_mode)) { unlink(path.c_str()); }
+
+	    if (bind(handle, (sockaddr*) &name, sizeof(name)) < 0)
+	    {
+	       close(handle);
+
+	       throw runtime_error("Couldn't listen on \"" + address + "\": " + strerror(errno));
+	    }
+
+	    socketPath = path;
+	 }
+
+	 else if (connect(handle, (sockaddr*) &name, sizeof(name)) < 0)
+	 {
+	    close(handle);
+
+	    throw runtime_error("Nothing listening on \"" + address + "\": " + strerror(errno));
+	 }
+
+	 return handle;
+      }
+
+      if (address.compare(0, 4, "udp:") != 0)
+      {
+	 throw runtime_error("Address \"" + address + "\" isn't udp:[host:]port or unix:path");
+      }
+
+      string host = "127.0.0.1", port = address.substr(4);
+
+      size_t colon = port.rfind(':');
+
+      if (colon != string::npos)
+      {
+	 host = port.substr(0, colon);
+	 port = port.substr(colon + 1);
+      }
+
+      addrinfo hints;
+      memset(&hints, 0, sizeof(hints));
+      hints.ai_family = AF_UNSPEC;
+      hints.ai_socktype = SOCK_DGRAM;
+      hints.ai_flags = AI_NUMERICSERV;
+
+      addrinfo* found = nullptr;
+
+      if (getaddrinfo(host.c_str(), port.c_str(), &hints, &found) || !found)
+      {
+	 throw runtime_error("Couldn't look up \"" + address + "\"");
+      }
+
+      handle = socket(found->ai_family, found->ai_socktype, found->ai_protocol);
+
+      bool opened = (handle >= 0) &&
+	 ((listening ? bind(handle, found->ai_addr, found->ai_addrlen) :
+	   connect(handle, found->ai_addr, found->ai_addrlen)) == 0);
+
+      string reason = strerror(errno);
+
+      freeaddrinfo(found);
+
+      if (!opened)
+      {
+	 if (handle >= 0) { close(handle); }
+
+	 throw runtime_error("Couldn't " + string(listening ? "listen on" : "send to") +
+			     " \"" + address + "\": " + reason);
+      }
+
+      return handle;
+   }
+}
+
+sweepReceiver::sweepReceiver(const string& address, size_t maxSurfels, size_t numBuffers)
+   : address (address)
+   , enabled (address.size())
+   , socketHandle (-1)
+   , maxSurfels (maxSurfels)
+   , anySweep (false)
+   , isFilling (false)
+   , fillingSweep (0)
+   , fillingPoints (0)
+   , fillingReceived (0)
+   , numPackets (0)
+   , numBadPackets (0)
+   , numLatePackets (0)
+   , numIncomplete (0)
+   , numCut (0)
+   , stopping (false)
+   , numReceived (0)
+   , numDropped (0)
+   , numSkipped (0)
+{
+   if (!enabled) { return; }
+
+   socketHandle = openSocket(address, true, socketPath);
+
+   setsockopt(socketHandle, SOL_SOCKET, SO_RCVBUF, &receiveBufferBytes, sizeof(receiveBufferBytes));
+
+   //One to fill, and the rest to wait to be taken; at least two of
+   //those, so there's always an older one to drop for a newer
+   filling.resize(maxSurfels * 4);
+
+   spare.assign(max(numBuffers, (size_t) 3) - 1, vector<float>(maxSurfels * 4));
+
+   receiver = thread(&sweepReceiver::work, this);
+}
+
+sweepReceiver::~sweepReceiver() { stop(); }
+
+void sweepReceiver::stop()
+{
+   {
+      lock_guard<mutex> guard(lock);
+
+      stopping = true;
+   }
+
+   if (receiver.joinable()) { receiver.join(); }
+
+   if (socketHandle >= 0)
+   {
+      close(socketHandle);
+      socketHandle = -1;
+
+      if (socketPath.size()) { unlink(socketPath.c_str()); }
+   }
+}
+
+void sweepReceiver::work()
+{
+   vector<char> packet(packetBytes);
+
+   while (true)
+   {
+      {
+	 lock_guard<mutex> guard(lock);
+
+	 if (stopping) { return; }
+      }
+
+      pollfd waiting = {socketHandle, POLLIN, 0};
+
+      if (poll(&waiting, 1, pollMs) <= 0) { continue; }
+
+      ssize_t bytes = recv(socketHandle, packet.data(), packet.size(), 0);
+
+      if (bytes >= 0) { decode(packet.data(), (size_t) bytes); }
+   }
+}
+
+void sweepReceiver::decode(const char* packet, size_t bytes)
+{
+   ++numPackets;
+
+   sweepPacket header;
+
+   if (bytes < sizeof(header)) { ++numBadPackets; return; }
+
+   memcpy(&header, packet, sizeof(header));
+
+   size_t pointBytes = bytes - sizeof(header);
+
+   if (memcmp(header.magic, sweepMagic, sizeof(sweepMagic)) ||
+       (pointBytes != (size_t) header.numPoints * 4 * sizeof(float)) ||
+       ((size_t) header.first + header.numPoints > header.sweepPoints))
+   {
+      ++numBadPackets;
+      return;
+   }
+
+   //Of a sweep already given up on (as numbers wrap), or already
+   //complete
+   if (anySweep && (((int32_t) (header.sweep - fillingSweep) < 0) ||
+		    ((header.sweep == fillingSweep) && !isFilling)))
+   {
+      ++numLatePackets;
+      return;
+   }
+
+   if (!anySweep || (header.sweep != fillingSweep))
+   {
+      if (isFilling) { ++numIncomplete; }
+
+      anySweep = true;
+      isFilling = true;
+      fillingSweep = header.sweep;
+      fillingPoints = header.sweepPoints;
+      fillingReceived = 0;
+   }
+
+   //Up to the buffer's end
+   size_t first = header.first;
+   size_t count = (first < maxSurfels) ? min((size_t) header.numPoints, maxSurfels - first) : 0;
+
+   memcpy(filling.data() + first * 4, packet + sizeof(header), count * 4 * sizeof(float));
+
+   fillingReceived += header.numPoints;
+
+   if (fillingReceived >= fillingPoints) { complete(); }
+}
+
+void sweepReceiver::complete()
+{
+   if (fillingPoints > maxSurfels) { ++numCut; }
+
+   isFilling = false;
+
+   lock_guard<mutex> guard(lock);
+
+   ready.push_back(sweep{vector<float>(), min(fillingPoints, maxSurfels)});
+   ready.back().surfels.swap(filling);
+
+   //None left to fill: the oldest's too old to be wanted now
+   if (!spare.size())
+   {
+      spare.push_back(move(ready.front().surfels));
+      ready.pop_front();
+
+      ++numDropped;
+   }
+
+   filling.swap(spare.back());
+   spare.pop_back();
+
+   ++numReceived;
+
+   completed.notify_one();
+}
+
+bool sweepReceiver::take(vector<float>& surfels, size_t& numSurfels, double waitSeconds)
+{
+   if (!enabled) { return false; }
+
+   //It goes back for filling
+   if (surfels.size() < maxSurfels * 4) { surfels.resize(maxSurfels * 4); }
+
+   unique_lock<mutex> guard(lock);
+
+   if (waitSeconds > 0.0)
+   {
+      completed.wait_for(guard, chrono::duration<double>(waitSeconds),
+			 [this]() { return ready.size() > 0; });
+   }
+
+   if (!ready.size()) { return false; }
+
+   surfels.swap(ready.front().surfels);
+   numSurfels = ready.front().numSurfels;
+
+   spare.push_back(move(ready.front().surfels));
+   ready.pop_front();
+
+   return true;
+}
+
+size_t sweepReceiver::skipToNewest()
+{
+   lock_guard<mutex> guard(lock);
+
+   size_t skipped = 0;
+
+   while (ready.size() > 1)
+   {
+      spare.push_back(move(ready.front().surfels));
+      ready.pop_front();
+
+      ++skipped;
+   }
+
+   numSkipped += skipped;
+
+   return skipped;
+}
+
+void sweepReceiver::printStats() const
+{
+   if (!enabled) { return; }
+
+   cout << "Received " << numReceived << " sweep(s) on " << address << " in " << numPackets
+	<< " packet(s); " << numIncomplete << " incomplete, " << numDropped
+	<< " dropped waiting, " << numSkipped << " skipped for newer, " << numCut
+	<< " cut short at " << maxSurfels << " surfels; " << numBadPackets << " bad and "
+	<< numLatePackets << " late packet(s)" << endl;
+}
+
+sweepSender::sweepSender(const string& address)
+   : socketHandle (-1)
+   , nextSweep (0)
+   , packet (packetBytes)
+   , numSent (0)
+   , numFailed (0)
+{
+   string socketPath;
+
+   socketHandle = openSocket(address, false, socketPath);
+}
+
+sweepSender::~sweepSender()
+{
+   if (socketHandle >= 0) { close(socketHandle); }
+}
+
+void sweepSender::send(const float* surfels, size_t numSurfels, double seconds)
+{
+   typedef chrono::steady_clock clock;
+
+   clock::time_point start = clock::now();
+
+   //At least one, so even an empty sweep's sent
+   size_t numPackets = max((numSurfels + maxPacketPoints - 1) / maxPacketPoints, (size_t) 1);
+
+   sweepPacket header;
+
+   memcpy(header.magic, sweepMagic, sizeof(sweepMagic));
+   header.sweep = nextSweep++;
+   header.sweepPoints = (uint32_t) numSurfels;
+
+   for (size_t i = 0; i < numPackets; ++i)
+   {
+      header.first = (uint32_t) (i * maxPacketPoints);
+      header.numPoints = (uint32_t) min((size_t) maxPacketPoints, numSurfels - header.first);
+
+      memcpy(packet.data(), &header, sizeof(header));
+      memcpy(packet.data() + sizeof(header), surfels + (size_t) header.first * 4,
+	     header.numPoints * 4 * sizeof(float));
+
+      size_t bytes = sizeof(header) + header.numPoints * 4 * sizeof(float);
+
+      if (::send(socketHandle, packet.data(), bytes, 0) == (ssize_t) bytes) { ++numSent; }
+
+      else { ++numFailed; }
+
+      this_thread::sleep_until(start + chrono::duration_cast<clock::duration>(
+				  chrono::duration<double>(seconds * (i + 1) / numPackets)));
+   }
+}
@@ -0,0 +1,159 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+  Each datagram a sensor (or sweepSender) sends: this header, then
+  numPoints points as 4 floats each (xyz, then radius, as surfels are).
+  Everything's little-endian, as x86 and ARM are, so it's sent as is.
+
+  A sweep's points may be split over any number of packets; each
+  says where its points go in the sweep, and how many the sweep has
+  in all, so it's complete once that many have come, in whatever
+  order. A packet of a newer sweep gives up on an incomplete one.
+*/
+struct sweepPacket
+{
+   char magic[4];
+   //Counts up, a sweep at a time; wraps
+   uint32_t sweep;
+   //Of this packet's points, within the sweep
+   uint32_t first;
+   uint32_t numPoints;
+   //In the whole sweep
+   uint32_t sweepPoints;
+};
+
+//"SWP1"
+extern const char sweepMagic[4];
+
+//So a packet fits a UDP datagram (65507 bytes at most)
+const uint32_t maxPacketPoints = 4000;
+
+/*
+  Addresses are local datagram sockets, either UDP, "udp:[host:]port"
+  (on 127.0.0.1 without a host), or Unix domain, "unix:path".
+*/
+
+class sweepReceiver
+/*
+  Listens on a socket for a sensor's sweeps, on a thread of its own,
+  and hands complete ones over to be drawn (see liveSurfels).
+
+  Packets are decoded straight into sweep buffers allocated up front,
+  each big enough for maxSurfels, so nothing's allocated as they come
+  in; points past that are dropped. Complete sweeps wait for take(),
+  oldest first, which swaps one for the caller's own buffer. If sweeps
+  come in faster than they're taken, so none are free to fill, the
+  oldest waiting is dropped.
+
+  With no address, it's off: nothing's opened, and take() never has
+  a sweep.
+*/
+{
+private:
+   struct sweep
+   {
+      std::vector<float> surfels;
+      size_t numSurfels;
+   };
+
+   std::string address;
+   bool enabled;
+   int socketHandle;
+   //Of a Unix domain socket, to unlink when done
+   std::string socketPath;
+
+   size_t maxSurfels;
+
+   std::thread receiver;
+
+   //Only the receiving thread touches these
+   std::vector<float> filling;
+   //Once any sweep's come, fillingSweep is the newest; it's complete
+   //unless isFilling
+   bool anySweep;
+   bool isFilling;
+   uint32_t fillingSweep;
+   size_t fillingPoints;
+   size_t fillingReceived;
+
+   size_t numPackets;
+   size_t numBadPackets;
+   size_t numLatePackets;
+   size_t numIncomplete;
+   size_t numCut;
+
+   //Everything below is guarded by lock
+   std::mutex lock;
+   std::condition_variable completed;
+
+   std::deque<sweep> ready;
+   std::vector<std::vector<float>> spare;
+   bool stopping;
+
+   size_t numReceived;
+   size_t numDropped;
+   size_t numSkipped;
+
+   void work();
+   void decode(const char* packet, size_t bytes);
+   //Hands filling over, and takes another to fill
+   void complete();
+
+public:
+   //Throws runtime_error if the socket can't be opened
+   sweepReceiver(const std::string& address, size_t maxSurfels, size_t numBuffers);
+   ~sweepReceiver();
+
+   /*
+     The oldest complete sweep, if one comes within waitSeconds: its
+     surfels (4 floats each) swapped into surfels, and how many.
+     surfels is grown to a whole buffer first, if it isn't one.
+   */
+   bool take(std::vector<float>& surfels, size_t& numSurfels, double waitSeconds = 0.0);
+
+   //Drops every complete sweep but the newest, and says how many
+   size_t skipToNewest();
+
+   //Stop listening, and close the socket
+   void stop();
+
+   //Say how many sweeps came in, and what was lost of them; after stop()
+   void printStats() const;
+};
+
+class sweepSender
+/*
+  Sends sweeps to a sweepReceiver's address, as a sensor would: each
+  sweep's packets spread out over the time it takes, rather than all
+  at once, so the receiver's socket doesn't overflow.
+*/
+{
+private:
+   int socketHandle;
+   uint32_t nextSweep;
+
+   std::vector<char> packet;
+
+   size_t numSent;
+   size_t numFailed;
+
+public:
+   //Throws runtime_error if the socket can't be opened
+   sweepSender(const std::string& address);
+   ~sweepSender();
+
+   //numSurfels, 4 floats each, over seconds; returns once they're up
+   void send(const float* surfels, size_t numSurfels, double seconds);
+
+   //Packets sent, and ones that couldn't be (e.g. with nothing listening)
+   size_t getNumSent() const { return numSent; }
+   size_t getNumFailed() const { return numFailed; }
+};
@@ -0,0 +1,259 @@
+#include "videoWriter.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+
+using namespace std;
+
+namespace
+{
+   bool endsWith(const string& text, const string& ending)
+   {
+      return ((text.size() >= ending.size()) &&
+	      (text.compare(text.size() - ending.size(), ending.size(), ending) == 0));
+   }
+
+   /*
+     Full-range BT.601 (as JPEG uses), in 16.16 fixed point. Y4M calls
+     it C420jpeg; chroma is sited between each 2x2 block of pixels, so
+     it's just their average.
+   */
+   inline uint8_t getLuma(int r, int g, int b)
+   {
+      return (uint8_t) ((19595 * r + 38470 * g + 7471 * b + 32768) >> 16);
+   }
+
+   //Pure blue (or red) would round up to 256
+   inline uint8_t getBlueChroma(int r, int g, int b)
+   {
+      return (uint8_t) min((-11059 * r - 21709 * g + 32768 * b
+			    + (128 << 16) + 32768) >> 16, 255);
+   }
+
+   inline uint8_t getRedChroma(int r, int g, int b)
+   {
+      return (uint8_t) min((32768 * r - 27439 * g - 5329 * b
+			    + (128 << 16) + 32768) >> 16, 255);
+   }
+}
+
+videoWriter::videoWriter(const string& fileName, unsigned int fps, size_t maxQueued)
+   : fileName (fileName)
+   , y4m (endsWith(fileName, ".y4m"))
+   , fps (fps)
+   , enabled (fileName.size())
+   , width (0)
+   , height (0)
+   , maxQueued (maxQueued ? maxQueued : 1)
+   , stopping (false)
+   , numWritten (0)
+   , numSkipped (0)
+   , failed (false)
+   , stalledSeconds (0.0)
+{
+   if (!enabled) { return; }
+
+   file.open(fileName, ofstream::out | ofstream::binary | ofstream::trunc);
+
+   if (!file.is_open())
+   {
+      throw runtime_error("Couldn't write video \"" + fileName + "\"");
+   }
+
+   writer = thread(&videoWriter::work, this);
+}
+
+videoWriter::~videoWriter() { finish(); }
+
+bool videoWriter::write(const job& frame)
+{
+   //The header goes with the first frame, which sets the size
+   if (!width)
+   {
+      width = frame.width; height = frame.height;
+
+      if (y4m)
+      {
+	 file << "YUV4MPEG2 W" << width << " H" << height << " F" << fps
+	      << ":1 Ip A1:1 C420jpeg\n";
+      }
+   }
+
+   if ((frame.width != width) || (frame.height != height))
+   {
+      lock_guard<mutex> held(lock);
+
+      ++numSkipped;
+
+      return true;
+   }
+
+   size_t numPixels = (size_t) width * (size_t) height;
+
+   //GL rows go from the bottom up
+   auto getPixel = [&](int x, int y)
+   {
+      return frame.rgba.data() + ((size_t) (height - 1 - y) * width + x) * 4;
+   };
+
+   if (!y4m)
+   {
+      converted.resize(numPixels * 3);
+
+      uint8_t* out = converted.data();
+
+      for (int y = 0; y < height; ++y)
+      {
+	 const uint8_t* pixel = getPixel(0, y);
+
+	 for (int x = 0; x < width; ++x, pixel += 4)
+	 {
+	    *out++ = pixel[0]; *out++ = pixel[1]; *out++ = pixel[2];
+	 }
+      }
+   }
+
+   else
+   {
+      int chromaX = (width + 1) / 2;
+      int chromaY = (height + 1) / 2;
+
+      size_t chromaPixels = (size_t) chromaX * (size_t) chromaY;
+
+      converted.resize(numPixels + 2 * chromaPixels);
+
+      uint8_t* luma = converted.data();
+      uint8_t* blue = luma + numPixels;
+      uint8_t* red = blue + chromaPixels;
+
+      for (int y = 0; y < height; ++y)
+      {
+	 const uint8_t* pixel = getPixel(0, y);
+
+	 for (int x = 0; x < width; ++x, pixel += 4)
+	 {
+	    *luma++ = getLuma(pixel[0], pixel[1], pixel[2]);
+	 }
+      }
+
+      for (int y = 0; y < chromaY; ++y)
+      {
+	 for (int x = 0; x < chromaX; ++x)
+	 {
+	    int r = 0, g = 0, b = 0, n = 0;
+
+	    //Past an odd edge there's only the one row or column
+	    for (int dy = 0; dy < 2; ++dy)
+	    {
+	       for (int dx = 0; dx < 2; ++dx)
+	       {
+		  int px = 2 * x + dx, py = 2 * y + dy;
+
+		  if ((px >= width) || (py >= height)) { continue; }
+
+		  const uint8_t* pixel = getPixel(px, py);
+
+		  r += pixel[0]; g += pixel[1]; b += pixel[2];
+		  ++n;
+	       }
+	    }
+
+	    r /= n; g /= n; b /= n;
+
+	    *blue++ = getBlueChroma(r, g, b);
+	    *red++ = getRedChroma(r, g, b);
+	 }
+      }
+
+      file << "FRAME\n";
+   }
+
+   file.write((const char*) converted.data(), converted.size());
+
+   return (bool) file;
+}
+
+void videoWriter::work()
+{
+   unique_lock<mutex> held(lock);
+
+   while (true)
+   {
+      queued.wait(held, [&]() { return stopping || !jobs.empty(); });
+
+      //Only once everything's written
+      if (jobs.empty()) { return; }
+
+      job next = move(jobs.front());
+      jobs.pop_front();
+
+      taken.notify_one();
+
+      held.unlock();
+
+      bool written = failed ? false : write(next);
+
+      held.lock();
+
+      if (written) { ++numWritten; }
+
+      else if (!failed)
+      {
+	 cerr << "Couldn't write to video \"" << fileName << "\"" << endl;
+
+	 failed = true;
+      }
+   }
+}
+
+void videoWriter::submit(int width, int height, vector<uint8_t>& rgba)
+{
+   if (!enabled) { return; }
+
+   unique_lock<mutex> held(lock);
+
+   if (jobs.size() >= maxQueued)
+   {
+      clock::time_point start = clock::now();
+
+      taken.wait(held, [&]() { return jobs.size() < maxQueued; });
+
+      stalledSeconds += chrono::duration<double>(clock::now() - start).count();
+   }
+
+   job next;
+
+   next.width = width; next.height = height;
+   next.rgba.swap(rgba);
+
+   jobs.push_back(move(next));
+
+   queued.notify_one();
+}
+
+bool videoWriter::finish()
+{
+   if (!writer.joinable()) { return !failed; }
+
+   {
+      lock_guard<mutex> held(lock);
+
+      stopping = true;
+   }
+
+   queued.notify_all();
+
+   writer.join();
+
+   file.close();
+
+   if (!file && !failed)
+   {
+      cerr << "Couldn't finish video \"" << fileName << "\"" << endl;
+
+      failed = true;
+   }
+
+   return !failed;
+}
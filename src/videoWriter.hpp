@@ -0,0 +1,92 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class videoWriter
+/*
+  Writes frames, in order, to one video file on a thread of its own:
+  YUV4MPEG2 (4:2:0, full range) if the name ends in .y4m, which
+  players and encoders like ffmpeg read as is; otherwise raw RGB24
+  frames one after another, with no header. The render loop only
+  hands frames over; converting and writing them is all on the
+  writer's thread.
+
+  A video's frames are all the size of the first; later frames of
+  other sizes (after the window's been resized) are skipped.
+
+  At most maxQueued frames wait to be written; past that, submit()
+  blocks til one's taken, rather than dropping frames from the video.
+
+  With no file name, it's off: nothing's made, and submit() does
+  nothing.
+*/
+{
+public:
+   typedef std::chrono::steady_clock clock;
+
+private:
+   struct job
+   {
+      int width, height;
+      //As read back: RGBA, bottom row first
+      std::vector<uint8_t> rgba;
+   };
+
+   std::ofstream file;
+   std::string fileName;
+   bool y4m;
+   unsigned int fps;
+   bool enabled;
+
+   //Of the video, once the first frame's in; only the writer's thread
+   //touches these
+   int width, height;
+   std::vector<uint8_t> converted;
+
+   std::thread writer;
+
+   //Everything below is guarded by lock
+   std::mutex lock;
+   std::condition_variable queued;
+   std::condition_variable taken;
+
+   std::deque<job> jobs;
+   size_t maxQueued;
+   bool stopping;
+
+   size_t numWritten;
+   size_t numSkipped;
+   bool failed;
+
+   //Only touched by the thread calling submit()
+   double stalledSeconds;
+
+   void work();
+   //False if it couldn't be written
+   bool write(const job& frame);
+
+public:
+   //Throws runtime_error if the file can't be made
+   videoWriter(const std::string& fileName, unsigned int fps, size_t maxQueued);
+   //Waits for everything to be written
+   ~videoWriter();
+
+   //Takes rgba's contents, leaving it empty
+   void submit(int width, int height, std::vector<uint8_t>& rgba);
+
+   //Wait til everything's written, and close the file. False, having
+   //said so, if anything couldn't be written.
+   bool finish();
+
+   size_t getNumWritten() const { return numWritten; }
+   size_t getNumSkipped() const { return numSkipped; }
+   double getStalledSeconds() const { return stalledSeconds; }
+};